@@ -0,0 +1,207 @@
+// Copyright 2012 by Runar Tenfjord, Tenko as.
+// See LICENSE.txt for details on conditions.
+#include "OCCModel.h"
+
+void OCCAssembly::clear()
+{
+    prototypes.clear();
+    instances.clear();
+    locations.clear();
+}
+
+// Leaves are the non compound shapes. The iterator composes the
+// locations and orientations of the compounds with the children.
+void OCCAssembly::addLeaves(const TopoDS_Shape& shape, PrototypeMap& lookup)
+{
+    if (shape.ShapeType() == TopAbs_COMPOUND) {
+        for (TopoDS_Iterator it(shape); it.More(); it.Next())
+            addLeaves(it.Value(), lookup);
+        return;
+    }
+    
+    std::pair<const TopoDS_TShape *, int> key(shape.TShape().operator->(),
+                                              (int)shape.Orientation());
+    PrototypeMap::iterator it = lookup.find(key);
+    int prototype;
+    if (it == lookup.end()) {
+        prototype = prototypes.size();
+        prototypes.push_back(shape.Located(TopLoc_Location()));
+        lookup[key] = prototype;
+    } else {
+        prototype = it->second;
+    }
+    instances.push_back(prototype);
+    locations.push_back(shape.Location());
+}
+
+int OCCAssembly::addShape(const TopoDS_Shape& shape)
+{
+    try {
+        if (shape.IsNull())
+            StdFail_NotDone::Raise("Null shape");
+        
+        PrototypeMap lookup;
+        for (unsigned int i = 0; i < prototypes.size(); i++) {
+            const TopoDS_Shape& proto = prototypes[i];
+            lookup[std::make_pair(proto.TShape().operator->(), (int)proto.Orientation())] = i;
+        }
+        addLeaves(shape, lookup);
+    } catch(Standard_Failure &err) {
+        setFailure("OCCAssembly::addShape", "Failed to add shape");
+        return 0;
+    }
+    return 1;
+}
+
+int OCCAssembly::addInstance(int prototype, DVec mat)
+{
+    try {
+        if (prototype < 0 || prototype >= (int)prototypes.size())
+            StdFail_NotDone::Raise("Prototype index out of range");
+        
+        // locations must be rigid transformations
+        if (mat.size() < 12 || matrixType(&mat[0]) != MATRIX_RIGID) {
+            setError("OCCAssembly::addInstance", "", "Matrix is not a rigid transformation");
+            return 0;
+        }
+        
+        gp_Trsf trans;
+        trans.SetValues(
+            mat[0], mat[1], mat[2], mat[3], 
+            mat[4], mat[5], mat[6], mat[7], 
+            mat[8], mat[9], mat[10], mat[11], 
+            0.00001,0.00001
+        );
+        instances.push_back(prototype);
+        locations.push_back(TopLoc_Location(trans));
+    } catch(Standard_Failure &err) {
+        setFailure("OCCAssembly::addInstance", "Failed to add instance");
+        return 0;
+    }
+    return 1;
+}
+
+TopoDS_Shape OCCAssembly::toShape()
+{
+    BRep_Builder B;
+    TopoDS_Compound C;
+    B.MakeCompound(C);
+    for (unsigned int i = 0; i < instances.size(); i++)
+        B.Add(C, prototypes[instances[i]].Located(locations[i]));
+    return C;
+}
+
+OCCBase *OCCAssembly::getPrototype(int prototype)
+{
+    if (prototype < 0 || prototype >= (int)prototypes.size()) {
+        setError("OCCAssembly::getPrototype", "", "Prototype index out of range");
+        return NULL;
+    }
+    OCCBase *ret = newShape(prototypes[prototype]);
+    if (ret == NULL)
+        setError("OCCAssembly::getPrototype", "", "Unknown shape type");
+    return ret;
+}
+
+// Return prototype index and the 3x4 row major matrix of instance
+int OCCAssembly::getInstance(int instance, double *mat)
+{
+    if (instance < 0 || instance >= (int)instances.size()) {
+        setError("OCCAssembly::getInstance", "", "Instance index out of range");
+        return -1;
+    }
+    const gp_Trsf trans = locations[instance].Transformation();
+    int k = 0;
+    for (int i = 1; i <= 3; i++) {
+        for (int j = 1; j <= 4; j++)
+            mat[k++] = trans.Value(i, j);
+    }
+    return instances[instance];
+}
+
+OCCMesh *OCCAssembly::createMesh(int prototype, double factor, double angle,
+                                 bool qualityNormals = false)
+{
+    if (prototype < 0 || prototype >= (int)prototypes.size()) {
+        setError("OCCAssembly::createMesh", "", "Prototype index out of range");
+        return NULL;
+    }
+    
+    const TopoDS_Shape& shape = prototypes[prototype];
+    OCCMesh *mesh = NULL;
+    switch (shape.ShapeType()) {
+    case TopAbs_COMPSOLID:
+    case TopAbs_SOLID:
+        {
+            OCCSolid solid;
+            solid.setShape(shape);
+            mesh = solid.createMesh(factor, angle, qualityNormals, false);
+        }
+        break;
+    case TopAbs_SHELL:
+    case TopAbs_FACE:
+        {
+            OCCFace face;
+            face.setShape(shape);
+            mesh = face.createMesh(factor, angle, qualityNormals);
+        }
+        break;
+    default:
+        setError("OCCAssembly::createMesh", "", "Prototype has no faces");
+    }
+    return mesh;
+}
+
+int OCCAssembly::readBREP(const char *filename)
+{
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file) {
+        setError("OCCAssembly::readBREP", "", "Failed to open file");
+        return 0;
+    }
+    
+    TopoDS_Shape shape;
+    if (!OCCTools::readBREP(file, shape))
+        return 0;
+    
+    clear();
+    return addShape(shape);
+}
+
+int OCCAssembly::readSTEP(const char *filename)
+{
+    TopoDS_Shape shape;
+    if (!OCCTools::readSTEP(filename, shape))
+        return 0;
+    
+    clear();
+    return addShape(shape);
+}
+
+// BREP keeps one copy of each TShape with a table of locations
+int OCCAssembly::writeBREP(const char *filename)
+{
+    std::ofstream file(filename, std::ios::out | std::ios::binary);
+    if (!file) {
+        setError("OCCAssembly::writeBREP", "", "Failed to open file");
+        return 0;
+    }
+    
+    try {
+        OCCTools::writeBREP(file, toShape());
+    } catch(Standard_Failure &err) {
+        setFailure("OCCAssembly::writeBREP", "Failed to write BREP file");
+        return 0;
+    }
+    file.close();
+    if (!file) {
+        setError("OCCAssembly::writeBREP", "", "Failed to write file");
+        return 0;
+    }
+    return 1;
+}
+
+int OCCAssembly::writeSTEP(const char *filename)
+{
+    return OCCTools::writeSTEP(filename, toShape(), true);
+}
@@ -0,0 +1,192 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of occmodel - See LICENSE.txt
+#
+
+cdef class Assembly:
+    '''
+    Assembly of prototype shapes placed by transformations.
+    
+    Instances of one prototype share the geometry, which is
+    stored, written and meshed once.
+    '''
+    cdef c_OCCAssembly *thisptr
+    
+    def __init__(self):
+        self.thisptr = new c_OCCAssembly()
+    
+    def __dealloc__(self):
+        if self.thisptr != NULL:
+            del self.thisptr
+    
+    def __str__(self):
+        return "Assembly%s" % repr(self)
+    
+    def __repr__(self):
+        args = self.nprototypes(), self.ninstances()
+        return "(nprototypes = %d, ninstances = %d)" % args
+    
+    def __len__(self):
+        return self.ninstances()
+    
+    cpdef int nprototypes(self):
+        '''
+        Return number of prototypes
+        '''
+        return self.thisptr.numPrototypes()
+    
+    cpdef int ninstances(self):
+        '''
+        Return number of instances
+        '''
+        return self.thisptr.numInstances()
+    
+    cpdef clear(self):
+        '''
+        Remove all prototypes and instances
+        '''
+        self.thisptr.clear()
+        return self
+    
+    cpdef addShape(self, Base shape):
+        '''
+        Add shape. Compounds are traversed and shapes sharing
+        geometry with existing prototypes are added as instances.
+        '''
+        cdef int ret
+        
+        shape.CheckPtr()
+        with nogil:
+            ret = self.thisptr.addShape(<c_OCCBase *>shape.thisptr)
+        if not ret:
+            raise lastError()
+        
+        return self
+    
+    cpdef addInstance(self, int prototype, Transform mat):
+        '''
+        Add instance of prototype.
+        
+        :param prototype: prototype index
+        :param mat: rigid transformation matrix, scaling and
+                    mirroring matrices are rejected
+        '''
+        cdef vector[double] cmat
+        cdef int i, j
+        
+        for i in range(3):
+            for j in range(4):
+                cmat.push_back(mat.m[i][j])
+        
+        if not self.thisptr.addInstance(prototype, cmat):
+            raise lastError()
+        
+        return self
+    
+    cpdef prototype(self, int index):
+        '''
+        Return prototype shape at given index
+        '''
+        cdef c_OCCBase *cshape = self.thisptr.getPrototype(index)
+        if cshape == NULL:
+            raise lastError()
+        
+        return wrapShape(cshape)
+    
+    cpdef instance(self, int index):
+        '''
+        Return tuple of prototype index and transformation
+        matrix of instance at given index
+        '''
+        cdef double cmat[12]
+        cdef Transform mat = Transform()
+        cdef int i, j
+        
+        cdef int prototype = self.thisptr.getInstance(index, cmat)
+        if prototype < 0:
+            raise lastError()
+        
+        for i in range(3):
+            for j in range(4):
+                mat.m[i][j] = cmat[4*i + j]
+        
+        return prototype, mat
+    
+    cpdef Mesh createMesh(self, int prototype, double factor = .01,
+                          double angle = .25, bint qualityNormals = False):
+        '''
+        Create triangle mesh of prototype. The mesh is placed by
+        the transformations of the instances.
+        
+        :param prototype: prototype index
+        :param factor: deflection from true position
+        :param angle: max angle
+        :param qualityNormals: create normals by evaluating surface parameters
+        '''
+        cdef c_OCCMesh *mesh
+        cdef Mesh ret
+        
+        with nogil:
+            mesh = self.thisptr.createMesh(prototype, factor, angle, qualityNormals)
+        
+        if mesh == NULL:
+            raise lastError()
+        
+        ret = Mesh.__new__(Mesh, None)
+        ret.thisptr = mesh
+        ret.setArrays()
+        return ret
+    
+    cpdef readBREP(self, char *filename):
+        '''
+        Read assembly from BREP file
+        '''
+        cdef int ret
+        
+        with nogil:
+            ret = self.thisptr.readBREP(filename)
+        if not ret:
+            raise lastError()
+        
+        return self
+    
+    cpdef readSTEP(self, char *filename):
+        '''
+        Read assembly from STEP file
+        '''
+        cdef int ret
+        
+        with nogil:
+            ret = self.thisptr.readSTEP(filename)
+        if not ret:
+            raise lastError()
+        
+        return self
+    
+    cpdef writeBREP(self, char *filename):
+        '''
+        Write assembly to BREP file
+        '''
+        cdef int ret
+        
+        with nogil:
+            ret = self.thisptr.writeBREP(filename)
+        if not ret:
+            raise lastError()
+        
+        return self
+    
+    cpdef writeSTEP(self, char *filename):
+        '''
+        Write assembly to STEP file. Instances are written
+        as placements of one product for each prototype.
+        '''
+        cdef int ret
+        
+        with nogil:
+            ret = self.thisptr.writeSTEP(filename)
+        if not ret:
+            raise lastError()
+        
+        return self
+
@@ -2,7 +2,54 @@
 // See LICENSE.txt for details on conditions.
 #include "OCCModel.h"
 
-int OCCBase::transform(DVec mat, OCCBase *target)
+// Apply rigid transformation. With share the shape location is moved
+// and the geometry is shared with the source, such that triangulations
+// and tolerances changed in place by meshing or healing one of them
+// are seen by the other. Otherwise the geometry is copied.
+void OCCBase::moveShape(const gp_Trsf& trans, OCCBase *target, bool share)
+{
+    if (share) {
+        // a rigid move can not change the validity of the shape
+        const int state = this->validState;
+        target->setShape(this->getShape().Moved(TopLoc_Location(trans)));
+        target->validState = state;
+    } else {
+        BRepBuilderAPI_Transform aTrans(this->getShape(), trans, Standard_True);
+        aTrans.Build();
+        aTrans.Check();
+        target->setShape(aTrans.Shape());
+    }
+}
+
+int OCCBase::transform(DVec mat, OCCBase *target, bool share = false)
+{
+    return this->transform(&mat[0], target, share);
+}
+
+// Transform by 3x4 row major matrix
+MatrixType matrixType(const double *mat)
+{
+    // Check if the columns of the linear part are orthogonal
+    // and of equal length, i.e. uniform scaling.
+    const double tol = 0.00001;
+    gp_XYZ c0(mat[0], mat[4], mat[8]);
+    gp_XYZ c1(mat[1], mat[5], mat[9]);
+    gp_XYZ c2(mat[2], mat[6], mat[10]);
+    const double s0 = c0.SquareModulus();
+    const bool uniform =
+        fabs(c1.SquareModulus() - s0) < tol*s0 &&
+        fabs(c2.SquareModulus() - s0) < tol*s0 &&
+        fabs(c0.Dot(c1)) < tol*s0 && fabs(c0.Dot(c2)) < tol*s0 &&
+        fabs(c1.Dot(c2)) < tol*s0;
+    
+    if (!uniform)
+        return MATRIX_GENERAL;
+    if (fabs(s0 - 1.0) < tol && c0.Dot(c1 ^ c2) > 0.)
+        return MATRIX_RIGID;
+    return MATRIX_UNIFORM;
+}
+
+int OCCBase::transform(const double *mat, OCCBase *target, bool share = false)
 {
     try {
         TopoDS_Shape shape = this->getShape();
@@ -10,9 +57,8 @@ int OCCBase::transform(DVec mat, OCCBase *target)
         if (shape.IsNull())
             StdFail_NotDone::Raise("Null shape");
         
-        // Check if scaling is non-uniform
-        double scaleTol = mat[0]*mat[5]*mat[10] - 1.0;
-        if (scaleTol > Precision::Confusion()) {
+        const MatrixType type = matrixType(mat);
+        if (type == MATRIX_GENERAL) {
             gp_GTrsf trans;
             int k = 0;
             for (int i = 1; i <= 3; i++) {
@@ -33,25 +79,23 @@ int OCCBase::transform(DVec mat, OCCBase *target)
                 mat[8], mat[9], mat[10], mat[11], 
                 0.00001,0.00001
             );
-            BRepBuilderAPI_Transform aTrans(shape, trans, Standard_True);
-            aTrans.Build();
-            aTrans.Check();
-            target->setShape(aTrans.Shape());
+            if (type == MATRIX_RIGID) {
+                this->moveShape(trans, target, share);
+            } else {
+                BRepBuilderAPI_Transform aTrans(shape, trans, Standard_True);
+                aTrans.Build();
+                aTrans.Check();
+                target->setShape(aTrans.Shape());
+            }
         }
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to transform object");
-        }
+        setFailure("OCCBase::transform", "Failed to transform object");
         return 0;
     }
     return 1;
 }
 
-int OCCBase::translate(OCCStruct3d delta, OCCBase *target)
+int OCCBase::translate(OCCStruct3d delta, OCCBase *target, bool share = false)
 {
     try {
         TopoDS_Shape shape = this->getShape();
@@ -61,24 +105,16 @@ int OCCBase::translate(OCCStruct3d delta, OCCBase *target)
         
         gp_Trsf trans;
         trans.SetTranslation(gp_Pnt(0,0,0), gp_Pnt(delta.x,delta.y,delta.z));
-        BRepBuilderAPI_Transform aTrans(shape, trans, Standard_True);
-        aTrans.Build();
-        aTrans.Check();
-        target->setShape(aTrans.Shape());
+        this->moveShape(trans, target, share);
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to translate object");
-        }
+        setFailure("OCCBase::translate", "Failed to translate object");
         return 0;
     }
     return 1;
 }
 
-int OCCBase::rotate(double angle, OCCStruct3d p1, OCCStruct3d p2, OCCBase *target)
+int OCCBase::rotate(double angle, OCCStruct3d p1, OCCStruct3d p2, OCCBase *target,
+                    bool share = false)
 {
     try {
         TopoDS_Shape shape = this->getShape();
@@ -90,18 +126,9 @@ int OCCBase::rotate(double angle, OCCStruct3d p1, OCCStruct3d p2, OCCBase *targe
         gp_Vec dir(gp_Pnt(p1.x, p1.y, p1.z), gp_Pnt(p2.x, p2.y, p2.z));
         gp_Ax1 axis(gp_Pnt(p1.x, p1.y, p1.z), dir);
         trans.SetRotation(axis, angle);
-        BRepBuilderAPI_Transform aTrans(shape, trans, Standard_True);
-        aTrans.Build();
-        aTrans.Check();
-        target->setShape(aTrans.Shape());
+        this->moveShape(trans, target, share);
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to rotate object");
-        }
+        setFailure("OCCBase::rotate", "Failed to rotate object");
         return 0;
     }
     return 1;
@@ -115,6 +142,7 @@ int OCCBase::scale(OCCStruct3d pnt, double scale, OCCBase *target)
         if (shape.IsNull())
             StdFail_NotDone::Raise("Null shape");
         
+        // scaling changes the geometry and can not be a location
         gp_Trsf trans;
         trans.SetScale(gp_Pnt(pnt.x,pnt.y,pnt.z), scale);
         BRepBuilderAPI_Transform aTrans(shape, trans, Standard_True);
@@ -122,13 +150,7 @@ int OCCBase::scale(OCCStruct3d pnt, double scale, OCCBase *target)
         aTrans.Check();
         target->setShape(aTrans.Shape());
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to scale object");
-        }
+        setFailure("OCCBase::scale", "Failed to scale object");
         return 0;
     }
     return 1;
@@ -148,13 +170,7 @@ int OCCBase::mirror(OCCStruct3d pnt, OCCStruct3d nor, OCCBase *target)
         BRepBuilderAPI_Transform aTrans(shape, trans, Standard_False);
         target->setShape(aTrans.Shape());
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to mirror object");
-        }
+        setFailure("OCCBase::mirror", "Failed to mirror object");
         return 0;
     }
     return 1;
@@ -209,13 +225,7 @@ int OCCBase::findPlane(OCCStruct3d *origin, OCCStruct3d *normal, double toleranc
         normal->z = dir.Z();
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to find plane");
-        }
+        setFailure("OCCBase::findPlane", "Failed to find plane");
         return 0;
     }
     return 1;   
@@ -239,48 +249,117 @@ bool OCCBase::isNull() {
     return this->getShape().IsNull() ? true : false;
 }
 
+static OCC_THREAD_LOCAL bool trustedMode = false;
+
+void OCCBase::setTrusted(bool trusted) {
+    trustedMode = trusted;
+}
+
+bool OCCBase::isTrusted() {
+    return trustedMode;
+}
+
 bool OCCBase::isValid() {
     if (this->getShape().IsNull())
         return false;
+    if (validState != VALID_UNKNOWN)
+        return validState == VALID_YES;
+    
     BRepCheck_Analyzer aChecker(this->getShape());
-    return aChecker.IsValid() ? true : false;
+    validState = aChecker.IsValid() ? VALID_YES : VALID_NO;
+    return validState == VALID_YES;
 }
 
 bool OCCBase::fixShape() {
     if (this->getShape().IsNull())
         return false;
     
+    if (trustedMode || validState == VALID_YES)
+        return true;
+    
     BRepCheck_Analyzer aChecker(this->getShape());
-    if (!aChecker.IsValid()) {
-        ShapeFix_ShapeTolerance aSFT;
-        aSFT.LimitTolerance(this->getShape(),Precision::Confusion(),Precision::Confusion());
-        
-        Handle(ShapeFix_Shape) aSfs = new ShapeFix_Shape(this->getShape());
-        aSfs->SetPrecision(Precision::Confusion());
-        aSfs->Perform();
-        
-        const TopoDS_Shape aShape = aSfs->Shape();
-        aChecker.Init(aShape, Standard_False);
-        
-        if (aChecker.IsValid() && this->canSetShape(aShape)) {
-            this->setShape(aShape);
-        }
+    if (aChecker.IsValid()) {
+        validState = VALID_YES;
+        return true;
+    }
+    
+    ShapeFix_ShapeTolerance aSFT;
+    aSFT.LimitTolerance(this->getShape(),Precision::Confusion(),Precision::Confusion());
+    
+    Handle(ShapeFix_Shape) aSfs = new ShapeFix_Shape(this->getShape());
+    aSfs->SetPrecision(Precision::Confusion());
+    aSfs->Perform();
+    
+    const TopoDS_Shape aShape = aSfs->Shape();
+    aChecker.Init(aShape, Standard_False);
+    
+    if (aChecker.IsValid() && this->canSetShape(aShape)) {
+        this->setShape(aShape);
+        validState = VALID_YES;
+    } else {
+        // tolerances may have changed in place
+        validState = VALID_UNKNOWN;
     }
     return aChecker.IsValid();
 }
 
-int OCCBase::toString(std::string *output) {
+bool OCCBase::fixShape(const OCCShapeSet& touched) {
+    if (this->getShape().IsNull())
+        return false;
+    
+    if (trustedMode || validState == VALID_YES)
+        return true;
+    
+    // The rest of the shape is known to be valid, check only the
+    // touched faces with their edges and vertices. Checks of the
+    // shell and solid as a whole are skipped.
+    if (touched.shapes.empty())
+        return this->fixShape();
+    
+    for (unsigned int i = 0; i < touched.shapes.size(); i++) {
+        BRepCheck_Analyzer aChecker(touched.shapes[i]);
+        if (!aChecker.IsValid())
+            return this->fixShape();
+    }
+    validState = VALID_YES;
+    return true;
+}
+
+int OCCBase::toString(std::string *output, bool binary = false, bool compress = false) {
+    if (binary)
+        return OCCTools::writeBinary(*output, this->getShape(), compress);
+    
     std::stringstream str;
     OCCTools::writeBREP(str, this->getShape());
     output->assign(str.str());
-    return 0;
+    return 1;
 }
 
 int OCCBase::fromString(std::string input) {
-    std::stringstream str(input);
+    TopoDS_Shape shape = TopoDS_Shape();
+    int ret;
+    
+    if (OCCTools::isBinary(input.data(), input.size())) {
+        ret = OCCTools::readBinary(input.data(), input.size(), shape);
+    } else {
+        std::stringstream str(input);
+        ret = OCCTools::readBREP(str, shape);
+    }
+    if (ret) {
+        if (this->canSetShape(shape))
+            this->setShape(shape);
+    }
+    return ret;
+}
+
+int OCCBase::toShared(const char *name, bool compress = false) {
+    return OCCTools::writeShared(name, this->getShape(), compress);
+}
+
+int OCCBase::fromShared(const char *name) {
     TopoDS_Shape shape = TopoDS_Shape();
     
-    int ret = OCCTools::readBREP(str, shape);
+    int ret = OCCTools::readShared(name, shape);
     if (ret) {
         if (this->canSetShape(shape))
             this->setShape(shape);
@@ -7,6 +7,12 @@ JOINTYPE_ARC = 0
 JOINTYPE_TANGENT = 1
 JOINTYPE_INTERSECTION = 2
 
+def restoreShape(cls, data):
+    '''
+    Restore pickled shape.
+    '''
+    return cls().fromString(data)
+
 cdef class Base:
     '''
     Definition of virtual base object
@@ -149,13 +155,17 @@ cdef class Base:
         
         return ret
     
-    cpdef transform(self, Transform mat, bint copy = False):
+    cpdef transform(self, Transform mat, bint copy = False, bint share = False):
         '''
         Apply transformation matrix to object.
         
         :param mat: Transformation matrix
         :param copy: If True the object is translated in place otherwise a
                      new translated object is returned.
+        :param share: If True a rigid move only changes the shape location
+                      and the geometry is shared with the source. Meshing
+                      or healing one of them then changes the other, and
+                      they must not be meshed on different threads at once.
         '''
         self.CheckPtr()
         
@@ -184,19 +194,23 @@ cdef class Base:
         cmat.push_back(mat.m[2][2])
         cmat.push_back(mat.m[2][3])
         
-        ret = occ.transform(cmat, <c_OCCBase *>target.thisptr)
+        ret = occ.transform(cmat, <c_OCCBase *>target.thisptr, share)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return target
         
-    cpdef translate(self, delta, bint copy = False):
+    cpdef translate(self, delta, bint copy = False, bint share = False):
         '''
         Translate object.
         
         :param delta: translation vector (dx,dy,dz)
         :param copy: If True the object is translated in place otherwise a
                      new translated object is returned.
+        :param share: If True a rigid move only changes the shape location
+                      and the geometry is shared with the source. Meshing
+                      or healing one of them then changes the other, and
+                      they must not be meshed on different threads at once.
         '''
         self.CheckPtr()
         
@@ -214,13 +228,14 @@ cdef class Base:
         cdelta.y = delta[1]
         cdelta.z = delta[2]
         
-        ret = occ.translate(cdelta, <c_OCCBase *>target.thisptr)
+        ret = occ.translate(cdelta, <c_OCCBase *>target.thisptr, share)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return target
     
-    cpdef rotate(self, double angle, axis, center = (0.,0.,0.), bint copy = False):
+    cpdef rotate(self, double angle, axis, center = (0.,0.,0.), bint copy = False,
+                 bint share = False):
         '''
         Rotate object.
         
@@ -229,6 +244,10 @@ cdef class Base:
         :param center: rotation center
         :param copy: If True the object is transformed in place otherwise a
                      new transformed object is returned.
+        :param share: If True a rigid move only changes the shape location
+                      and the geometry is shared with the source. Meshing
+                      or healing one of them then changes the other, and
+                      they must not be meshed on different threads at once.
         '''
         self.CheckPtr()
         
@@ -254,9 +273,9 @@ cdef class Base:
         cp2.y = p2.y
         cp2.z = p2.z
         
-        ret = occ.rotate(angle, cp1, cp2, <c_OCCBase *>target.thisptr)
+        ret = occ.rotate(angle, cp1, cp2, <c_OCCBase *>target.thisptr, share)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return target
 
@@ -287,7 +306,7 @@ cdef class Base:
         
         ret = occ.scale(cpnt, scale, <c_OCCBase *>target.thisptr)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return target
 
@@ -321,38 +340,99 @@ cdef class Base:
         
         ret = occ.mirror(cpnt, cnor, <c_OCCBase *>target.thisptr)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return target
         
-    cpdef toString(self):
+    cpdef toString(self, bint binary = False, bint compress = False):
         '''
         Seralize object to string.
         
-        The format used is the OpenCASCADE internal BREP format.
+        The format used is the OpenCASCADE internal BREP format
+        or the more compact binary format.
+        
+        :param binary: use binary format
+        :param compress: compress binary data
         '''
         self.CheckPtr()
         
         cdef c_OCCBase *occ = <c_OCCBase *>self.thisptr
         cdef string res = string()
+        cdef int ret
         
-        occ.toString(&res)
-        ret = str(res.c_str())
+        with nogil:
+            ret = occ.toString(&res, binary, compress)
+        if not ret:
+            raise lastError()
         
-        return ret
+        if binary:
+            return res.c_str()[:res.size()]
+        
+        return str(res.c_str())
     
-    cpdef fromString(self, char *st):
+    cpdef fromString(self, bytes st):
         '''
         Restore shape from string.
         
-        The format used is the OpenCASCADE internal BREP format.
+        The BREP and binary formats are detected automatically.
+        '''
+        self.CheckPtr()
+        
+        cdef c_OCCBase *occ = <c_OCCBase *>self.thisptr
+        cdef string cst = string(<char *>st, len(st))
+        cdef int ret
+        
+        with nogil:
+            ret = occ.fromString(cst)
+        if not ret:
+            raise lastError()
+        
+        return self
+    
+    cpdef toShared(self, char *name, bint compress = False):
+        '''
+        Write shape in binary format to the named shared memory
+        segment, for transfer to other processes. The segment is
+        kept until removed with Tools.removeShared.
+        
+        Uncompressed data is written straight into the segment
+        and read in place by fromShared, without copies.
+        
+        :param name: segment name
+        :param compress: compress binary data, which saves memory
+                         but the reader decompresses it to a
+                         private buffer
         '''
         self.CheckPtr()
         
         cdef c_OCCBase *occ = <c_OCCBase *>self.thisptr
-        cdef string cst= string(st)
+        cdef int ret
         
-        if not occ.fromString(cst):
-            raise OCCError(errorMessage)
+        with nogil:
+            ret = occ.toShared(name, compress)
+        if not ret:
+            raise lastError()
         
-        return self
\ No newline at end of file
+        return self
+    
+    cpdef fromShared(self, char *name):
+        '''
+        Restore shape from named shared memory segment. The data
+        is read in place from the mapped segment.
+        '''
+        self.CheckPtr()
+        
+        cdef c_OCCBase *occ = <c_OCCBase *>self.thisptr
+        cdef int ret
+        
+        with nogil:
+            ret = occ.fromShared(name)
+        if not ret:
+            raise lastError()
+        
+        return self
+    
+    def __reduce__(self):
+        if self.isNull():
+            return (self.__class__, ())
+        return (restoreShape, (self.__class__, self.toString(True, True)))
\ No newline at end of file
@@ -0,0 +1,155 @@
+// Copyright 2012 by Runar Tenfjord, Tenko as.
+// See LICENSE.txt for details on conditions.
+#include "OCCModel.h"
+
+// Block compression in the LZ4 block format. A block is a sequence
+// of a token byte (literal length in the high and match length in the
+// low nibble), extra literal length bytes, the literals, a 2 byte
+// little endian match offset and extra match length bytes. Lengths of
+// 15 or more continue in following bytes of 255 until a smaller byte.
+// The last sequence holds literals only.
+
+static const int minMatch = 4;
+static const int lastLiterals = 5;
+static const int matchLimit = 12;
+static const int hashLog = 14;
+static const unsigned int maxOffset = 65535;
+
+static inline unsigned int read32(const unsigned char *p)
+{
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) |
+           ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static inline unsigned int hash32(unsigned int v)
+{
+    return (v*2654435761U) >> (32 - hashLog);
+}
+
+static void writeLength(std::string& output, size_t len)
+{
+    while (len >= 255) {
+        output.push_back((char)255);
+        len -= 255;
+    }
+    output.push_back((char)len);
+}
+
+static void writeSequence(std::string& output, const unsigned char *literals,
+                          size_t nliterals, size_t offset, size_t matchlen)
+{
+    const size_t ml = matchlen > 0 ? matchlen - minMatch : 0;
+    unsigned char token = (unsigned char)((nliterals < 15 ? nliterals : 15) << 4);
+    token |= (unsigned char)(ml < 15 ? ml : 15);
+    output.push_back((char)token);
+
+    if (nliterals >= 15)
+        writeLength(output, nliterals - 15);
+    output.append((const char *)literals, nliterals);
+
+    if (matchlen == 0)
+        return;
+
+    output.push_back((char)(offset & 0xff));
+    output.push_back((char)((offset >> 8) & 0xff));
+    if (ml >= 15)
+        writeLength(output, ml - 15);
+}
+
+void compressBlock(const char *input, size_t size, std::string& output)
+{
+    const unsigned char *src = (const unsigned char *)input;
+    output.clear();
+    output.reserve(size + size/255 + 16);
+
+    size_t anchor = 0;
+    if (size > matchLimit) {
+        std::vector<size_t> table(1 << hashLog, (size_t)-1);
+        const size_t limit = size - matchLimit;
+        size_t pos = 0;
+
+        while (pos < limit) {
+            const unsigned int seq = read32(src + pos);
+            const unsigned int h = hash32(seq);
+            const size_t ref = table[h];
+            table[h] = pos;
+
+            if (ref == (size_t)-1 || pos - ref > maxOffset ||
+                read32(src + ref) != seq) {
+                pos++;
+                continue;
+            }
+
+            // extend match, the last literals are never part of a match
+            size_t len = minMatch;
+            const size_t maxlen = size - lastLiterals - pos;
+            while (len < maxlen && src[ref + len] == src[pos + len])
+                len++;
+
+            writeSequence(output, src + anchor, pos - anchor, pos - ref, len);
+            pos += len;
+            anchor = pos;
+        }
+    }
+
+    writeSequence(output, src + anchor, size - anchor, 0, 0);
+}
+
+static bool readLength(const unsigned char *& ip, const unsigned char *end, size_t& len)
+{
+    unsigned char b;
+    do {
+        if (ip >= end)
+            return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool decompressBlock(const char *input, size_t size, char *output, size_t outsize)
+{
+    const unsigned char *ip = (const unsigned char *)input;
+    const unsigned char *end = ip + size;
+    unsigned char *op = (unsigned char *)output;
+    unsigned char *oend = op + outsize;
+
+    while (ip < end) {
+        const unsigned char token = *ip++;
+
+        size_t nliterals = token >> 4;
+        if (nliterals == 15 && !readLength(ip, end, nliterals))
+            return false;
+        if ((size_t)(end - ip) < nliterals || (size_t)(oend - op) < nliterals)
+            return false;
+        memcpy(op, ip, nliterals);
+        ip += nliterals;
+        op += nliterals;
+
+        // last sequence
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return false;
+        const size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (unsigned char *)output))
+            return false;
+
+        size_t matchlen = token & 15;
+        if (matchlen == 15 && !readLength(ip, end, matchlen))
+            return false;
+        matchlen += minMatch;
+        if ((size_t)(oend - op) < matchlen)
+            return false;
+
+        // copy byte by byte as the match may overlap the output
+        const unsigned char *match = op - offset;
+        for (size_t i = 0; i < matchlen; i++)
+            op[i] = match[i];
+        op += matchlen;
+    }
+
+    return op == oend;
+}
@@ -35,13 +35,7 @@ OCCEdge *OCCEdge::copy(bool deepCopy = false)
             ret->setShape(this->getShape());
         }
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to copy edge");
-        }
+        setFailure("OCCEdge::copy", "Failed to copy edge");
         return NULL;
     }
     return ret;
@@ -61,10 +55,10 @@ OCCTesselation *OCCEdge::tesselate(double angular, double curvature)
         Standard_Real start, end;
         OCCStruct3f vert;
         
-        TopLoc_Location loc = this->getEdge().Location();
+        // curve without location, which is applied to the points
+        TopLoc_Location loc;
+        const Handle(Geom_Curve)& curve = BRep_Tool::Curve(this->getEdge(), loc, start, end);
         gp_Trsf location = loc.Transformation();
-        
-        const Handle(Geom_Curve)& curve = BRep_Tool::Curve(this->getEdge(), start, end);
         const GeomAdaptor_Curve& aCurve(curve);
 		
         GCPnts_TangentialDeflection TD(aCurve, start, end, angular, curvature);
@@ -94,13 +88,7 @@ int OCCEdge::createLine(OCCVertex *start, OCCVertex *end) {
         GC_MakeLine line(aP1, aP2);
         this->setShape(BRepBuilderAPI_MakeEdge(line, start->vertex, end->vertex));
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create line");
-        }
+        setFailure("OCCEdge::createLine", "Failed to create line");
         return 0;
     }
     return 1;
@@ -123,13 +111,7 @@ int OCCEdge::createArc(OCCVertex *start, OCCVertex *end, OCCStruct3d center) {
         
         this->setShape(BRepBuilderAPI_MakeEdge(arc, start->vertex, end->vertex));
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create arc");
-        }
+        setFailure("OCCEdge::createArc", "Failed to create arc");
         return 0;
     }
     return 1;
@@ -143,13 +125,7 @@ int OCCEdge::createArc3P(OCCVertex *start, OCCVertex *end, OCCStruct3d aPoint) {
         GC_MakeArcOfCircle arc(aP1, aP2, aP3);
         this->setShape(BRepBuilderAPI_MakeEdge(arc, start->vertex, end->vertex));
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create arc");
-        }
+        setFailure("OCCEdge::createArc3P", "Failed to create arc");
         return 0;
     }
     return 1;
@@ -168,13 +144,7 @@ int OCCEdge::createCircle(OCCStruct3d center, OCCStruct3d normal, double radius)
         gce_MakeCirc circle(aP1, aD1, radius);
         this->setShape(BRepBuilderAPI_MakeEdge(circle));
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create circle");
-        }
+        setFailure("OCCEdge::createCircle", "Failed to create circle");
         return 0;
     }
     return 1;
@@ -192,13 +162,7 @@ int OCCEdge::createEllipse(OCCStruct3d pnt, OCCStruct3d nor, double rMajor, doub
         gce_MakeElips ellipse(ax2, rMajor, rMinor);
         this->setShape(BRepBuilderAPI_MakeEdge(ellipse));
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create ellipse");
-        }
+        setFailure("OCCEdge::createEllipse", "Failed to create ellipse");
         return 0;
     }
     return 1;
@@ -237,13 +201,7 @@ int OCCEdge::createHelix(double pitch, double height, double radius, double angl
         BRepLib::BuildCurves3d(edge);
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create helix");
-        }
+        setFailure("OCCEdge::createHelix", "Failed to create helix");
         return 0;
     }
     return 1;
@@ -286,13 +244,7 @@ int OCCEdge::createBezier(OCCVertex *start, OCCVertex *end, std::vector<OCCStruc
         }
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create bezier");
-        }
+        setFailure("OCCEdge::createBezier", "Failed to create bezier");
         return 0;
     }
     return 1;
@@ -339,13 +291,7 @@ int OCCEdge::createSpline(OCCVertex *start, OCCVertex *end, std::vector<OCCStruc
             this->setShape(BRepBuilderAPI_MakeEdge(curve));
         }
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create spline");
-        }
+        setFailure("OCCEdge::createSpline", "Failed to create spline");
         return 0;
     }
     return 1;
@@ -410,13 +356,7 @@ int OCCEdge::createNURBS(OCCVertex *start, OCCVertex *end, std::vector<OCCStruct
             this->setShape(BRepBuilderAPI_MakeEdge(NURBS));
         }
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create nurbs");
-        }
+        setFailure("OCCEdge::createNURBS", "Failed to create nurbs");
         return 1;
     }
     return 0;
@@ -108,7 +108,7 @@ cdef class Edge(Base):
         cdef Tesselation ret = Tesselation.__new__(Tesselation, None)
         
         if tess == NULL:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         ret.thisptr = tess
         ret.setArrays()
@@ -140,7 +140,7 @@ cdef class Edge(Base):
         ret = occ.createLine(<c_OCCVertex *>vstart.thisptr, <c_OCCVertex *>vend.thisptr)
         
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -175,7 +175,7 @@ cdef class Edge(Base):
                             <c_OCCVertex *>vend.thisptr, cpnt)
         
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -211,7 +211,7 @@ cdef class Edge(Base):
                               <c_OCCVertex *>vend.thisptr, cpnt)
         
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -238,7 +238,7 @@ cdef class Edge(Base):
         ret = occ.createCircle(ccen, cnor, radius)
         
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -266,7 +266,7 @@ cdef class Edge(Base):
         ret = occ.createEllipse(ccen, cnor, rMajor, rMinor)
         
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -284,7 +284,7 @@ cdef class Edge(Base):
         ret = occ.createHelix(pitch, height, radius, angle, leftHanded)
         
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -321,7 +321,7 @@ cdef class Edge(Base):
                                    <c_OCCVertex *>end.thisptr, cpoints)
             
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
 
@@ -360,7 +360,7 @@ cdef class Edge(Base):
                                    <c_OCCVertex *>end.thisptr, cpoints, tolerance)
             
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
 
@@ -413,7 +413,7 @@ cdef class Edge(Base):
                                    cknots, cweights, cmults)
             
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -14,13 +14,7 @@ OCCFace *OCCFace::copy(bool deepCopy = false)
             ret->setShape(this->getShape());
         }
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to copy face");
-        }
+        setFailure("OCCFace::copy", "Failed to copy face");
         return NULL;
     }
     return ret;
@@ -74,13 +68,7 @@ int OCCFace::createFace(std::vector<OCCWire *> wires) {
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create face");
-        }
+        setFailure("OCCFace::createFace", "Failed to create face");
         return 0;
     }
     return 1;
@@ -105,13 +93,7 @@ int OCCFace::createConstrained(std::vector<OCCEdge *> edges, std::vector<OCCStru
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create face");
-        }
+        setFailure("OCCFace::createConstrained", "Failed to create face");
         return 0;
     }
     return 1;
@@ -171,13 +153,7 @@ int OCCFace::offset(double offset, double tolerance = 1e-6) {
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to offset face");
-        }
+        setFailure("OCCFace::offset", "Failed to offset face");
         return 0;
     }
     return 1;
@@ -202,13 +178,7 @@ int OCCFace::createPolygonal(std::vector<OCCStruct3d> points)
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create face");
-        }
+        setFailure("OCCFace::createPolygonal", "Failed to create face");
         return 0;
     }
     return 1;
@@ -235,13 +205,7 @@ int OCCFace::extrude(OCCBase *shape, OCCStruct3d p1, OCCStruct3d p2) {
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to extrude");
-        }
+        setFailure("OCCFace::extrude", "Failed to extrude");
         return 0;
     }
     return 1;
@@ -271,13 +235,7 @@ int OCCFace::revolve(OCCBase *shape, OCCStruct3d p1, OCCStruct3d p2, double angl
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to revolve");
-        }
+        setFailure("OCCFace::revolve", "Failed to revolve");
         return 0;
     }
     return 1;
@@ -312,13 +270,7 @@ int OCCFace::sweep(OCCWire *spine, std::vector<OCCBase *> profiles, int cornerMo
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to sweep");
-        }
+        setFailure("OCCFace::sweep", "Failed to sweep");
         return 0;
     }
     return 1;
@@ -353,13 +305,7 @@ int OCCFace::loft(std::vector<OCCBase *> profiles, bool ruled, double tolerance)
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to loft");
-        }
+        setFailure("OCCFace::loft", "Failed to loft");
         return 0;
     }
     return 1;
@@ -420,13 +366,7 @@ int OCCFace::boolean(OCCSolid *tool, BoolOpType op) {
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed in boolean operation");
-        }
+        setFailure("OCCFace::boolean", "Failed in boolean operation");
         return 0;
     }
     return 1;
@@ -434,7 +374,11 @@ int OCCFace::boolean(OCCSolid *tool, BoolOpType op) {
 
 OCCMesh *OCCFace::createMesh(double factor, double angle, bool qualityNormals = true)
 {
-    OCCMesh *mesh = new OCCMesh();
+    OCCMesh *mesh = OCCMeshCache::find(this->getShape(), factor, angle, qualityNormals);
+    if (mesh != NULL)
+        return mesh;
+    
+    mesh = new OCCMesh();
     
     try {
         Bnd_Box aBox;
@@ -455,24 +399,29 @@ OCCMesh *OCCFace::createMesh(double factor, double angle, bool qualityNormals =
         
         BRepMesh::Mesh(this->getShape(),factor*maxd);
         
+        std::vector<TopoDS_Face> faces;
         if (this->getShape().ShapeType() != TopAbs_FACE) {
             TopExp_Explorer exFace;
             for (exFace.Init(this->getShape(), TopAbs_FACE); exFace.More(); exFace.Next()) {
                 const TopoDS_Face& faceref = static_cast<const TopoDS_Face &>(exFace.Current());
-                mesh->extractFaceMesh(faceref, qualityNormals);
+                faces.push_back(faceref);
             }
         } else {
-            mesh->extractFaceMesh(this->getFace(), qualityNormals);
+            faces.push_back(this->getFace());
         }
-    } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create mesh");
+        
+        // failed or empty meshes are not cached
+        if (!mesh->extractFaces(faces, qualityNormals, false)) {
+            if (faces.empty())
+                setError("OCCFace::createMesh", "StdFail_NotDone", "No faces to mesh");
+            delete mesh;
+            return NULL;
         }
+    } catch(Standard_Failure &err) {
+        delete mesh;
+        setFailure("OCCFace::createMesh", "Failed to create mesh");
         return NULL;
     }
+    OCCMeshCache::insert(this->getShape(), factor, angle, qualityNormals, mesh);
     return mesh;
 }
\ No newline at end of file
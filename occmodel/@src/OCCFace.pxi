@@ -76,11 +76,15 @@ cdef class Face(Base):
         :param qualityNormals: create normals by evaluating surface parameters
         '''
         cdef c_OCCFace *occ = <c_OCCFace *>self.thisptr
-        cdef c_OCCMesh *mesh = occ.createMesh(factor, angle, qualityNormals)
-        cdef Mesh ret = Mesh.__new__(Mesh, None)
+        cdef c_OCCMesh *mesh
+        cdef Mesh ret
+
+        with nogil:
+            mesh = occ.createMesh(factor, angle, qualityNormals)
+        ret = Mesh.__new__(Mesh, None)
         
         if mesh == NULL:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         ret.thisptr = mesh
         ret.setArrays()
@@ -123,7 +127,7 @@ cdef class Face(Base):
             cwires.push_back(<c_OCCWire *>wire.thisptr)
             
         if not occ.createFace(cwires):
-            raise OCCError(errorMessage)
+            raise lastError()
         
         return self
         
@@ -163,7 +167,7 @@ cdef class Face(Base):
             
         ret = occ.createConstrained(cedges, cpoints)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         if not self.isValid() or self.isNull():
             raise OCCError('Failed to create face')
@@ -192,7 +196,7 @@ cdef class Face(Base):
             cpoints.push_back(tmp)
         
         if not occ.createPolygonal(cpoints):
-            raise OCCError(errorMessage)
+            raise lastError()
             
         if not self.isValid() or self.isNull():
             raise OCCError('Failed to create face')
@@ -235,9 +239,10 @@ cdef class Face(Base):
         cdef c_OCCFace *occ = <c_OCCFace *>self.thisptr
         cdef int ret
         
-        ret = occ.offset(offset, tolerance)
+        with nogil:
+            ret = occ.offset(offset, tolerance)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         return self
         
@@ -266,9 +271,10 @@ cdef class Face(Base):
         cp2.y = p2[1]
         cp2.z = p2[2]
         
-        ret = occ.extrude(<c_OCCBase *>shape.thisptr, cp1, cp2)
+        with nogil:
+            ret = occ.extrude(<c_OCCBase *>shape.thisptr, cp1, cp2)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -299,9 +305,10 @@ cdef class Face(Base):
         cp2.y = p2[1]
         cp2.z = p2[2]
         
-        ret = occ.revolve(<c_OCCBase *>shape.thisptr, cp1, cp2, angle)
+        with nogil:
+            ret = occ.revolve(<c_OCCBase *>shape.thisptr, cp1, cp2, angle)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
 
@@ -346,10 +353,11 @@ cdef class Face(Base):
             cobj = obj
             cprofiles.push_back((<c_OCCBase *>cobj.thisptr))
         
-        ret = occ.sweep(<c_OCCWire *>cspine.thisptr, cprofiles, cornerMode)
+        with nogil:
+            ret = occ.sweep(<c_OCCWire *>cspine.thisptr, cprofiles, cornerMode)
         
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -384,10 +392,11 @@ cdef class Face(Base):
             cobj = obj
             cprofiles.push_back((<c_OCCBase *>cobj.thisptr))
         
-        ret = occ.loft(cprofiles, ruled, tolerance)
+        with nogil:
+            ret = occ.loft(cprofiles, ruled, tolerance)
         
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -442,7 +451,8 @@ cdef class Face(Base):
             tool = arg
         
         if op in (BOOL_CUT, BOOL_COMMON):
-            ret = occ.boolean(<c_OCCSolid *>tool.thisptr, op)
+            with nogil:
+                ret = occ.boolean(<c_OCCSolid *>tool.thisptr, op)
         else:
             raise OCCError('uknown operation')
         
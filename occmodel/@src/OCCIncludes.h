@@ -6,6 +6,7 @@ using std::iostream;
 #include <StdFail_NotDone.hxx>
 #include <gp_Pnt.hxx>
 #include <gp_Vec.hxx>
+#include <gp_Trsf.hxx>
 #include <TColgp_HArray1OfPnt.hxx>
 #include <TShort_Array1OfShortReal.hxx>
 #include <TColStd_HArray1OfReal.hxx>
@@ -34,6 +35,7 @@ using std::iostream;
 #include <GeomAPI_ProjectPointOnSurf.hxx>
 #include <GeomAPI_ProjectPointOnCurve.hxx>
 #include <BRepTools.hxx>
+#include <BinTools_ShapeSet.hxx>
 #include <TopExp.hxx>
 #include <BRepBuilderAPI_MakeVertex.hxx>
 #include <BRepBuilderAPI_MakeEdge.hxx>
@@ -43,6 +45,12 @@ using std::iostream;
 #include <BRepOffsetAPI_Sewing.hxx>
 #include <BRepLProp_SLProps.hxx>
 #include <BRepAdaptor_Surface.hxx>
+#include <GeomAbs_SurfaceType.hxx>
+#include <gp_Ax3.hxx>
+#include <gp_Pln.hxx>
+#include <gp_Cylinder.hxx>
+#include <gp_Cone.hxx>
+#include <gp_Sphere.hxx>
 #include <Poly_Triangulation.hxx>
 #include <Poly_Array1OfTriangle.hxx>
 #include <TColgp_Array1OfPnt2d.hxx>
@@ -85,6 +93,15 @@ using std::iostream;
 #include <BRepGProp.hxx>
 #include <IGESControl_Reader.hxx>
 #include <STEPControl_Reader.hxx>
+#include <XSControl_WorkSession.hxx>
+#include <XSControl_TransferReader.hxx>
+#include <STEPControl_ActorRead.hxx>
+#include <Interface_InterfaceModel.hxx>
+#include <STEPConstruct_UnitContext.hxx>
+#include <StepRepr_RepresentationContext.hxx>
+#include <StepRepr_GlobalUnitAssignedContext.hxx>
+#include <StepGeom_GeometricRepresentationContextAndGlobalUnitAssignedContext.hxx>
+#include <StepGeom_GeomRepContextAndGlobUnitAssCtxAndGlobUncertaintyAssCtx.hxx>
 #include <TopoDS_Shape.hxx>
 #include <TopoDS_Face.hxx>
 #include <IGESToBRep_Reader.hxx>
@@ -92,6 +109,9 @@ using std::iostream;
 #include <GeomAPI_ExtremaCurveCurve.hxx>
 #include <Standard_ErrorHandler.hxx>
 #include <Standard_Failure.hxx>
+#include <Standard_Mutex.hxx>
+#include <OSD_Thread.hxx>
+#include <OSD_Timer.hxx>
 #include <ShapeUpgrade_ShellSewing.hxx>
 #include <ShapeFix_ShapeTolerance.hxx>
 #include <ShapeFix_Shape.hxx>
@@ -135,11 +155,18 @@ using std::iostream;
 #include <BRepPrimAPI_MakeCone.hxx>
 #include <BRepPrimAPI_MakeTorus.hxx>
 #include <TopTools_ListIteratorOfListOfShape.hxx>
+#include <BRepBuilderAPI_MakeShape.hxx>
 #include <TopTools_HSequenceOfShape.hxx>
 #include <Precision.hxx>
 #include <BRepAlgoAPI_Common.hxx>
 #include <BRepAlgoAPI_Cut.hxx>
 #include <BRepAlgoAPI_Section.hxx>
+#include <Standard_Version.hxx>
+#if OCC_VERSION_HEX >= 0x060600
+#include <BOPAlgo_BOP.hxx>
+#include <BOPAlgo_Operation.hxx>
+#include <ShapeUpgrade_UnifySameDomain.hxx>
+#endif
 #include <BRepAlgoAPI_Fuse.hxx>
 #include <BRepOffsetAPI_NormalProjection.hxx>
 #include <BRepOffsetAPI_MakeOffset.hxx>
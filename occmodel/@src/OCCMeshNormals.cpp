@@ -0,0 +1,352 @@
+// Copyright 2012 by Runar Tenfjord, Tenko as.
+// See LICENSE.txt for details on conditions.
+#include "OCCModel.h"
+
+// Kernels for mesh normal calculation. The vertex coordinates are
+// passed as separate x, y, z arrays (SoA). The SIMD versions are
+// compiled with target attributes and selected at runtime, so the
+// library itself is still built for the baseline instruction set.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OCC_SIMD_X86
+#include <immintrin.h>
+#endif
+
+static const float degenerateTol = 1.0e-10f;
+
+// Normal of triangle i as cross product of the edges from the
+// first vertex. Triangles with short edges or area are flagged as
+// degenerated.
+static inline bool triangleNormal(const float *x, const float *y, const float *z,
+                                  const unsigned int *tri, int i,
+                                  float& cx, float& cy, float& cz)
+{
+    const unsigned int n1 = tri[3*i], n2 = tri[3*i + 1], n3 = tri[3*i + 2];
+
+    const float ax = x[n2] - x[n1], ay = y[n2] - y[n1], az = z[n2] - z[n1];
+    const float bx = x[n3] - x[n1], by = y[n3] - y[n1], bz = z[n3] - z[n1];
+
+    cx = ay*bz - az*by;
+    cy = az*bx - ax*bz;
+    cz = ax*by - ay*bx;
+
+    return (ax*ax + ay*ay + az*az >= degenerateTol) &
+           (bx*bx + by*by + bz*bz >= degenerateTol) &
+           (cx*cx + cy*cy + cz*cz >= degenerateTol);
+}
+
+static inline void scatterNormal(const unsigned int *tri, int i,
+                                 float cx, float cy, float cz,
+                                 float *vnx, float *vny, float *vnz)
+{
+    for (int j = 0; j < 3; j++) {
+        const unsigned int n = tri[3*i + j];
+        vnx[n] += cx;
+        vny[n] += cy;
+        vnz[n] += cz;
+    }
+}
+
+// The scalar version adds each normal directly, without the
+// intermediate face normal arrays of the SIMD versions.
+static void accumulateScalar(const float *x, const float *y, const float *z,
+                             const unsigned int *tri, int ntris,
+                             float *vnx, float *vny, float *vnz,
+                             unsigned char *valid)
+{
+    for (int i = 0; i < ntris; i++) {
+        float cx, cy, cz;
+        valid[i] = triangleNormal(x, y, z, tri, i, cx, cy, cz);
+        if (valid[i])
+            scatterNormal(tri, i, cx, cy, cz, vnx, vny, vnz);
+    }
+}
+
+static void normalizeScalar(float *nx, float *ny, float *nz, int n)
+{
+    for (int i = 0; i < n; i++) {
+        const float len2 = nx[i]*nx[i] + ny[i]*ny[i] + nz[i]*nz[i];
+        if (len2 > degenerateTol) {
+            const float inv = 1.0f/sqrtf(len2);
+            nx[i] *= inv;
+            ny[i] *= inv;
+            nz[i] *= inv;
+        }
+    }
+}
+
+#ifdef OCC_SIMD_X86
+// The SIMD versions compute the face normals for a block of
+// triangles, which are then added to the vertices one by one as
+// vertices are shared between triangles.
+static const int normalBlock = 256;
+
+static void scatterBlock(const unsigned int *tri, int ntris,
+                         const float *nx, const float *ny, const float *nz,
+                         const unsigned char *valid,
+                         float *vnx, float *vny, float *vnz)
+{
+    for (int i = 0; i < ntris; i++) {
+        if (valid[i])
+            scatterNormal(tri, i, nx[i], ny[i], nz[i], vnx, vny, vnz);
+    }
+}
+
+static void triangleNormalsScalar(const float *x, const float *y, const float *z,
+                                  const unsigned int *tri, int ntris,
+                                  float *nx, float *ny, float *nz,
+                                  unsigned char *valid)
+{
+    for (int i = 0; i < ntris; i++)
+        valid[i] = triangleNormal(x, y, z, tri, i, nx[i], ny[i], nz[i]);
+}
+
+__attribute__((target("sse2")))
+static void triangleNormalsSSE(const float *x, const float *y, const float *z,
+                               const unsigned int *tri, int ntris,
+                               float *nx, float *ny, float *nz,
+                               unsigned char *valid)
+{
+    const __m128 tol = _mm_set1_ps(degenerateTol);
+    int i = 0;
+    for (; i + 4 <= ntris; i += 4) {
+        const unsigned int *t = &tri[3*i];
+
+        const __m128 x1 = _mm_setr_ps(x[t[0]], x[t[3]], x[t[6]], x[t[9]]);
+        const __m128 y1 = _mm_setr_ps(y[t[0]], y[t[3]], y[t[6]], y[t[9]]);
+        const __m128 z1 = _mm_setr_ps(z[t[0]], z[t[3]], z[t[6]], z[t[9]]);
+
+        const __m128 ax = _mm_sub_ps(_mm_setr_ps(x[t[1]], x[t[4]], x[t[7]], x[t[10]]), x1);
+        const __m128 ay = _mm_sub_ps(_mm_setr_ps(y[t[1]], y[t[4]], y[t[7]], y[t[10]]), y1);
+        const __m128 az = _mm_sub_ps(_mm_setr_ps(z[t[1]], z[t[4]], z[t[7]], z[t[10]]), z1);
+
+        const __m128 bx = _mm_sub_ps(_mm_setr_ps(x[t[2]], x[t[5]], x[t[8]], x[t[11]]), x1);
+        const __m128 by = _mm_sub_ps(_mm_setr_ps(y[t[2]], y[t[5]], y[t[8]], y[t[11]]), y1);
+        const __m128 bz = _mm_sub_ps(_mm_setr_ps(z[t[2]], z[t[5]], z[t[8]], z[t[11]]), z1);
+
+        const __m128 cx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+        const __m128 cy = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+        const __m128 cz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+
+        _mm_storeu_ps(&nx[i], cx);
+        _mm_storeu_ps(&ny[i], cy);
+        _mm_storeu_ps(&nz[i], cz);
+
+        const __m128 la = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay)), _mm_mul_ps(az, az));
+        const __m128 lb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bx, bx), _mm_mul_ps(by, by)), _mm_mul_ps(bz, bz));
+        const __m128 lc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz));
+        const int mask = _mm_movemask_ps(_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(la, tol),
+                                                               _mm_cmpge_ps(lb, tol)),
+                                                    _mm_cmpge_ps(lc, tol)));
+        valid[i + 0] = (mask >> 0) & 1;
+        valid[i + 1] = (mask >> 1) & 1;
+        valid[i + 2] = (mask >> 2) & 1;
+        valid[i + 3] = (mask >> 3) & 1;
+    }
+    triangleNormalsScalar(x, y, z, &tri[3*i], ntris - i, &nx[i], &ny[i], &nz[i], &valid[i]);
+}
+
+__attribute__((target("sse2")))
+static void normalizeSSE(float *nx, float *ny, float *nz, int n)
+{
+    const __m128 tol = _mm_set1_ps(degenerateTol);
+    const __m128 one = _mm_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_loadu_ps(&nx[i]);
+        const __m128 y = _mm_loadu_ps(&ny[i]);
+        const __m128 z = _mm_loadu_ps(&nz[i]);
+        const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        const __m128 mask = _mm_cmpgt_ps(len2, tol);
+        // scale by one where the normal is degenerated
+        const __m128 inv = _mm_or_ps(_mm_and_ps(mask, _mm_div_ps(one, _mm_sqrt_ps(len2))),
+                                     _mm_andnot_ps(mask, one));
+        _mm_storeu_ps(&nx[i], _mm_mul_ps(x, inv));
+        _mm_storeu_ps(&ny[i], _mm_mul_ps(y, inv));
+        _mm_storeu_ps(&nz[i], _mm_mul_ps(z, inv));
+    }
+    normalizeScalar(&nx[i], &ny[i], &nz[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static void triangleNormalsAVX2(const float *x, const float *y, const float *z,
+                                const unsigned int *tri, int ntris,
+                                float *nx, float *ny, float *nz,
+                                unsigned char *valid)
+{
+    const __m256 tol = _mm256_set1_ps(degenerateTol);
+    // offsets of the first vertex index of 8 consecutive triangles
+    const __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    int i = 0;
+    for (; i + 8 <= ntris; i += 8) {
+        const int *t = (const int *)&tri[3*i];
+        const __m256i i1 = _mm256_i32gather_epi32(t, stride, 4);
+        const __m256i i2 = _mm256_i32gather_epi32(t + 1, stride, 4);
+        const __m256i i3 = _mm256_i32gather_epi32(t + 2, stride, 4);
+
+        const __m256 x1 = _mm256_i32gather_ps(x, i1, 4);
+        const __m256 y1 = _mm256_i32gather_ps(y, i1, 4);
+        const __m256 z1 = _mm256_i32gather_ps(z, i1, 4);
+
+        const __m256 ax = _mm256_sub_ps(_mm256_i32gather_ps(x, i2, 4), x1);
+        const __m256 ay = _mm256_sub_ps(_mm256_i32gather_ps(y, i2, 4), y1);
+        const __m256 az = _mm256_sub_ps(_mm256_i32gather_ps(z, i2, 4), z1);
+
+        const __m256 bx = _mm256_sub_ps(_mm256_i32gather_ps(x, i3, 4), x1);
+        const __m256 by = _mm256_sub_ps(_mm256_i32gather_ps(y, i3, 4), y1);
+        const __m256 bz = _mm256_sub_ps(_mm256_i32gather_ps(z, i3, 4), z1);
+
+        const __m256 cx = _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by));
+        const __m256 cy = _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz));
+        const __m256 cz = _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx));
+
+        _mm256_storeu_ps(&nx[i], cx);
+        _mm256_storeu_ps(&ny[i], cy);
+        _mm256_storeu_ps(&nz[i], cz);
+
+        const __m256 la = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, ax), _mm256_mul_ps(ay, ay)), _mm256_mul_ps(az, az));
+        const __m256 lb = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(bx, bx), _mm256_mul_ps(by, by)), _mm256_mul_ps(bz, bz));
+        const __m256 lc = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)), _mm256_mul_ps(cz, cz));
+        const int mask = _mm256_movemask_ps(_mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(la, tol, _CMP_GE_OQ),
+                                                                        _mm256_cmp_ps(lb, tol, _CMP_GE_OQ)),
+                                                          _mm256_cmp_ps(lc, tol, _CMP_GE_OQ)));
+        for (int j = 0; j < 8; j++)
+            valid[i + j] = (mask >> j) & 1;
+    }
+    triangleNormalsScalar(x, y, z, &tri[3*i], ntris - i, &nx[i], &ny[i], &nz[i], &valid[i]);
+}
+
+__attribute__((target("avx2")))
+static void normalizeAVX2(float *nx, float *ny, float *nz, int n)
+{
+    const __m256 tol = _mm256_set1_ps(degenerateTol);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 x = _mm256_loadu_ps(&nx[i]);
+        const __m256 y = _mm256_loadu_ps(&ny[i]);
+        const __m256 z = _mm256_loadu_ps(&nz[i]);
+        const __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+        const __m256 mask = _mm256_cmp_ps(len2, tol, _CMP_GT_OQ);
+        // scale by one where the normal is degenerated
+        const __m256 inv = _mm256_blendv_ps(one, _mm256_div_ps(one, _mm256_sqrt_ps(len2)), mask);
+        _mm256_storeu_ps(&nx[i], _mm256_mul_ps(x, inv));
+        _mm256_storeu_ps(&ny[i], _mm256_mul_ps(y, inv));
+        _mm256_storeu_ps(&nz[i], _mm256_mul_ps(z, inv));
+    }
+    normalizeScalar(&nx[i], &ny[i], &nz[i], n - i);
+}
+
+typedef void (*TriangleNormalsFunction)(const float *x, const float *y, const float *z,
+                                        const unsigned int *tri, int ntris,
+                                        float *nx, float *ny, float *nz,
+                                        unsigned char *valid);
+
+static void accumulateBlocks(TriangleNormalsFunction func,
+                             const float *x, const float *y, const float *z,
+                             const unsigned int *tri, int ntris,
+                             float *vnx, float *vny, float *vnz,
+                             unsigned char *valid)
+{
+    float nx[normalBlock], ny[normalBlock], nz[normalBlock];
+    for (int i = 0; i < ntris; i += normalBlock) {
+        const int n = std::min(normalBlock, ntris - i);
+        func(x, y, z, &tri[3*i], n, nx, ny, nz, &valid[i]);
+        scatterBlock(&tri[3*i], n, nx, ny, nz, &valid[i], vnx, vny, vnz);
+    }
+}
+#endif
+
+// The kernel may be set while meshes are created on other threads
+static int requestedKernel = NORMALS_AUTO;
+
+static inline NormalKernel loadKernel()
+{
+#if defined(__GNUC__)
+    return (NormalKernel)__atomic_load_n(&requestedKernel, __ATOMIC_RELAXED);
+#else
+    return (NormalKernel)*(volatile int *)&requestedKernel;
+#endif
+}
+
+static inline void storeKernel(NormalKernel kernel)
+{
+#if defined(__GNUC__)
+    __atomic_store_n(&requestedKernel, (int)kernel, __ATOMIC_RELAXED);
+#else
+    *(volatile int *)&requestedKernel = (int)kernel;
+#endif
+}
+
+static bool kernelSupported(NormalKernel kernel)
+{
+    switch (kernel) {
+        case NORMALS_SCALAR:
+            return true;
+#ifdef OCC_SIMD_X86
+        case NORMALS_SSE:
+            return __builtin_cpu_supports("sse2");
+        case NORMALS_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+bool setNormalKernel(NormalKernel kernel)
+{
+    if (kernel != NORMALS_AUTO && !kernelSupported(kernel))
+        return false;
+    storeKernel(kernel);
+    return true;
+}
+
+// The automatic choice is the fastest kernel measured. The scatter
+// of normals to the vertices dominates, where the AVX2 gathers give
+// no gain over SSE2.
+NormalKernel getNormalKernel()
+{
+    const NormalKernel kernel = loadKernel();
+    if (kernel != NORMALS_AUTO)
+        return kernel;
+    if (kernelSupported(NORMALS_SSE))
+        return NORMALS_SSE;
+    return NORMALS_SCALAR;
+}
+
+void accumulateNormals(const float *x, const float *y, const float *z,
+                       const unsigned int *tri, int ntris,
+                       float *vnx, float *vny, float *vnz, unsigned char *valid)
+{
+    switch (getNormalKernel()) {
+#ifdef OCC_SIMD_X86
+        case NORMALS_AVX2:
+            accumulateBlocks(triangleNormalsAVX2, x, y, z, tri, ntris, vnx, vny, vnz, valid);
+            break;
+        case NORMALS_SSE:
+            accumulateBlocks(triangleNormalsSSE, x, y, z, tri, ntris, vnx, vny, vnz, valid);
+            break;
+#endif
+        default:
+            accumulateScalar(x, y, z, tri, ntris, vnx, vny, vnz, valid);
+            break;
+    }
+}
+
+void normalizeNormals(float *nx, float *ny, float *nz, int n)
+{
+    switch (getNormalKernel()) {
+#ifdef OCC_SIMD_X86
+        case NORMALS_AVX2:
+            normalizeAVX2(nx, ny, nz, n);
+            break;
+        case NORMALS_SSE:
+            normalizeSSE(nx, ny, nz, n);
+            break;
+#endif
+        default:
+            normalizeScalar(nx, ny, nz, n);
+            break;
+    }
+}
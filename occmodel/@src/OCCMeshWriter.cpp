@@ -0,0 +1,401 @@
+// Copyright 2012 by Runar Tenfjord, Tenko as.
+// See LICENSE.txt for details on conditions.
+#include "OCCModel.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <float.h>
+
+// Writers for binary STL and glTF binary (GLB) files taking the data
+// directly from the vertex, normal and triangle arrays of meshes. All
+// values are written little endian through a fixed size buffer.
+
+class MeshFileWriter {
+public:
+    MeshFileWriter(const char *filename) : ok(true), buffer(1 << 20), pos(0) {
+        fh = fopen(filename, "wb");
+        if (fh == NULL)
+            ok = false;
+    }
+    ~MeshFileWriter() {
+        close();
+    }
+    bool close() {
+        if (fh != NULL) {
+            flush();
+            if (fclose(fh) != 0)
+                ok = false;
+            fh = NULL;
+        }
+        return ok;
+    }
+    void put(const void *data, size_t size) {
+        const char *src = (const char *)data;
+        while (size > 0) {
+            if (pos == buffer.size())
+                flush();
+            const size_t n = std::min(size, buffer.size() - pos);
+            memcpy(&buffer[pos], src, n);
+            pos += n;
+            src += n;
+            size -= n;
+        }
+    }
+    void putU8(unsigned char v) {
+        put(&v, 1);
+    }
+    void putU16(unsigned int v) {
+        unsigned char b[2] = {(unsigned char)(v & 0xff), (unsigned char)((v >> 8) & 0xff)};
+        put(b, 2);
+    }
+    void putU32(unsigned int v) {
+        unsigned char b[4] = {(unsigned char)(v & 0xff), (unsigned char)((v >> 8) & 0xff),
+                              (unsigned char)((v >> 16) & 0xff), (unsigned char)((v >> 24) & 0xff)};
+        put(b, 4);
+    }
+    void putF32(float v) {
+        unsigned int bits;
+        memcpy(&bits, &v, 4);
+        putU32(bits);
+    }
+    void pad(size_t size, unsigned char value) {
+        for (size_t i = 0; i < size; i++)
+            putU8(value);
+    }
+    bool ok;
+private:
+    void flush() {
+        if (pos > 0 && fh != NULL && fwrite(&buffer[0], 1, pos, fh) != pos)
+            ok = false;
+        pos = 0;
+    }
+    FILE *fh;
+    std::vector<char> buffer;
+    size_t pos;
+};
+
+int OCCTools::writeMeshSTL(const char *filename, std::vector<OCCMesh *> meshes)
+{
+    MeshFileWriter writer(filename);
+    if (!writer.ok) {
+        setError("OCCTools::writeMeshSTL", "", "Failed to open file");
+        return 0;
+    }
+
+    unsigned int ntriangles = 0;
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        ntriangles += meshes[i]->triangles.size();
+
+    char header[80];
+    memset(header, 0, sizeof(header));
+    strncpy(header, "occmodel binary STL", sizeof(header) - 1);
+    writer.put(header, sizeof(header));
+    writer.putU32(ntriangles);
+
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        const std::vector<OCCStruct3f>& vertices = meshes[i]->vertices;
+        const std::vector<OCCStruct3I>& triangles = meshes[i]->triangles;
+
+        for (unsigned int j = 0; j < triangles.size(); j++) {
+            const OCCStruct3f& p1 = vertices[triangles[j].i];
+            const OCCStruct3f& p2 = vertices[triangles[j].j];
+            const OCCStruct3f& p3 = vertices[triangles[j].k];
+
+            // facet normal
+            const float ax = p2.x - p1.x, ay = p2.y - p1.y, az = p2.z - p1.z;
+            const float bx = p3.x - p1.x, by = p3.y - p1.y, bz = p3.z - p1.z;
+            float nx = ay*bz - az*by, ny = az*bx - ax*bz, nz = ax*by - ay*bx;
+            const float len = sqrt(nx*nx + ny*ny + nz*nz);
+            if (len > 0.f) {
+                nx /= len; ny /= len; nz /= len;
+            }
+
+            writer.putF32(nx); writer.putF32(ny); writer.putF32(nz);
+            writer.putF32(p1.x); writer.putF32(p1.y); writer.putF32(p1.z);
+            writer.putF32(p2.x); writer.putF32(p2.y); writer.putF32(p2.z);
+            writer.putF32(p3.x); writer.putF32(p3.y); writer.putF32(p3.z);
+            writer.putU16(0);
+        }
+    }
+
+    if (!writer.close()) {
+        setError("OCCTools::writeMeshSTL", "", "Failed to write STL file");
+        return 0;
+    }
+    return 1;
+}
+
+// glTF constants
+static const unsigned int GLTF_BYTE = 5120;
+static const unsigned int GLTF_SHORT = 5122;
+static const unsigned int GLTF_UNSIGNED_SHORT = 5123;
+static const unsigned int GLTF_UNSIGNED_INT = 5125;
+static const unsigned int GLTF_FLOAT = 5126;
+static const unsigned int GLTF_ARRAY_BUFFER = 34962;
+static const unsigned int GLTF_ELEMENT_ARRAY_BUFFER = 34963;
+
+static inline size_t align4(size_t size)
+{
+    return (size + 3) & ~(size_t)3;
+}
+
+static inline int quantizeUnit(float v)
+{
+    const float q = v*127.f;
+    return (int)(q < 0.f ? q - .5f : q + .5f);
+}
+
+// Layout of one mesh in the binary chunk
+struct GLBMeshLayout {
+    float min[3];
+    float max[3];
+    float scale[3];
+    int qmin[3];
+    int qmax[3];
+    size_t positionOffset;
+    size_t positionStride;
+    size_t normalOffset;
+    size_t normalStride;
+    size_t indexOffset;
+    size_t indexSize;
+    size_t end;
+};
+
+// Signed 16 bit position component, p = min + (q + 32768)*scale
+static inline int quantizePosition(const GLBMeshLayout& info, int k, float v)
+{
+    const int q = (int)((v - info.min[k])/info.scale[k] + .5f);
+    return std::min(std::max(q, 0), 65535) - 32768;
+}
+
+static void appendf(std::string& str, const char *fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    str.append(buf);
+}
+
+int OCCTools::writeMeshGLB(const char *filename, std::vector<OCCMesh *> meshes,
+                           bool quantize = false)
+{
+    // empty buffer views are not allowed
+    std::vector<OCCMesh *> nonempty;
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        if (meshes[i]->vertices.size() > 0 && meshes[i]->triangles.size() > 0)
+            nonempty.push_back(meshes[i]);
+    }
+    meshes.swap(nonempty);
+
+    // binary chunk layout
+    std::vector<GLBMeshLayout> layout(meshes.size());
+    size_t offset = 0;
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        const OCCMesh *mesh = meshes[i];
+        GLBMeshLayout& info = layout[i];
+        const size_t nvertices = mesh->vertices.size();
+
+        for (int j = 0; j < 3; j++) {
+            info.min[j] = nvertices > 0 ? FLT_MAX : 0.f;
+            info.max[j] = nvertices > 0 ? -FLT_MAX : 0.f;
+        }
+        for (unsigned int j = 0; j < nvertices; j++) {
+            const float *v = &mesh->vertices[j].x;
+            for (int k = 0; k < 3; k++) {
+                info.min[k] = std::min(info.min[k], v[k]);
+                info.max[k] = std::max(info.max[k], v[k]);
+            }
+        }
+        for (int j = 0; j < 3; j++) {
+            const float extent = info.max[j] - info.min[j];
+            info.scale[j] = extent > 0.f ? extent/65535.f : 1.f;
+        }
+
+        // accessor bounds must match the stored values exactly
+        for (int j = 0; j < 3; j++) {
+            info.qmin[j] = nvertices > 0 ? 32767 : 0;
+            info.qmax[j] = nvertices > 0 ? -32768 : 0;
+        }
+        if (quantize) {
+            for (unsigned int j = 0; j < nvertices; j++) {
+                const float *v = &mesh->vertices[j].x;
+                for (int k = 0; k < 3; k++) {
+                    const int q = quantizePosition(info, k, v[k]);
+                    info.qmin[k] = std::min(info.qmin[k], q);
+                    info.qmax[k] = std::max(info.qmax[k], q);
+                }
+            }
+        }
+
+        // vertex attributes must be aligned to 4 bytes
+        info.positionStride = quantize ? 8 : 12;
+        info.normalStride = quantize ? 4 : 12;
+        info.indexSize = nvertices <= 65535 ? 2 : 4;
+
+        info.positionOffset = offset;
+        offset += nvertices*info.positionStride;
+        info.normalOffset = offset;
+        offset += nvertices*info.normalStride;
+        info.indexOffset = offset;
+        offset += align4(3*mesh->triangles.size()*info.indexSize);
+        info.end = offset;
+    }
+    const size_t binSize = offset;
+
+    // json chunk
+    std::string json;
+    json.append("{\"asset\":{\"version\":\"2.0\",\"generator\":\"occmodel\"},");
+    if (quantize)
+        json.append("\"extensionsUsed\":[\"KHR_mesh_quantization\"],"
+                    "\"extensionsRequired\":[\"KHR_mesh_quantization\"],");
+    json.append("\"scene\":0,\"scenes\":[{\"nodes\":[");
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        appendf(json, "%s%u", i > 0 ? "," : "", i);
+    json.append("]}],\"nodes\":[");
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        const GLBMeshLayout& info = layout[i];
+        appendf(json, "%s{\"mesh\":%u", i > 0 ? "," : "", i);
+        if (quantize) {
+            // dequantize with node transform, p = min + (q + 32768)*scale
+            appendf(json, ",\"translation\":[%.9g,%.9g,%.9g]",
+                    info.min[0] + 32768.*info.scale[0],
+                    info.min[1] + 32768.*info.scale[1],
+                    info.min[2] + 32768.*info.scale[2]);
+            appendf(json, ",\"scale\":[%.9g,%.9g,%.9g]",
+                    info.scale[0], info.scale[1], info.scale[2]);
+        }
+        json.append("}");
+    }
+    json.append("],\"meshes\":[");
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        appendf(json, "%s{\"primitives\":[{\"attributes\":{\"POSITION\":%u,\"NORMAL\":%u},"
+                "\"indices\":%u,\"mode\":4}]}", i > 0 ? "," : "", 3*i, 3*i + 1, 3*i + 2);
+    json.append("],\"accessors\":[");
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        const GLBMeshLayout& info = layout[i];
+        const unsigned int nvertices = meshes[i]->vertices.size();
+        if (i > 0)
+            json.append(",");
+        if (quantize) {
+            appendf(json, "{\"bufferView\":%u,\"componentType\":%u,\"count\":%u,\"type\":\"VEC3\","
+                    "\"min\":[%d,%d,%d],\"max\":[%d,%d,%d]},", 3*i, GLTF_SHORT, nvertices,
+                    info.qmin[0], info.qmin[1], info.qmin[2],
+                    info.qmax[0], info.qmax[1], info.qmax[2]);
+            appendf(json, "{\"bufferView\":%u,\"componentType\":%u,\"normalized\":true,"
+                    "\"count\":%u,\"type\":\"VEC3\"},", 3*i + 1, GLTF_BYTE, nvertices);
+        } else {
+            appendf(json, "{\"bufferView\":%u,\"componentType\":%u,\"count\":%u,\"type\":\"VEC3\","
+                    "\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},", 3*i, GLTF_FLOAT,
+                    nvertices, info.min[0], info.min[1], info.min[2],
+                    info.max[0], info.max[1], info.max[2]);
+            appendf(json, "{\"bufferView\":%u,\"componentType\":%u,\"count\":%u,\"type\":\"VEC3\"},",
+                    3*i + 1, GLTF_FLOAT, nvertices);
+        }
+        appendf(json, "{\"bufferView\":%u,\"componentType\":%u,\"count\":%u,\"type\":\"SCALAR\"}",
+                3*i + 2, info.indexSize == 2 ? GLTF_UNSIGNED_SHORT : GLTF_UNSIGNED_INT,
+                (unsigned int)(3*meshes[i]->triangles.size()));
+    }
+    json.append("],\"bufferViews\":[");
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        const GLBMeshLayout& info = layout[i];
+        appendf(json, "%s{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"byteStride\":%u,\"target\":%u},",
+                i > 0 ? "," : "", (unsigned int)info.positionOffset,
+                (unsigned int)(info.normalOffset - info.positionOffset),
+                (unsigned int)info.positionStride, GLTF_ARRAY_BUFFER);
+        appendf(json, "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"byteStride\":%u,\"target\":%u},",
+                (unsigned int)info.normalOffset,
+                (unsigned int)(info.indexOffset - info.normalOffset),
+                (unsigned int)info.normalStride, GLTF_ARRAY_BUFFER);
+        appendf(json, "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"target\":%u}",
+                (unsigned int)info.indexOffset,
+                (unsigned int)(3*meshes[i]->triangles.size()*info.indexSize),
+                GLTF_ELEMENT_ARRAY_BUFFER);
+    }
+    appendf(json, "],\"buffers\":[{\"byteLength\":%u}]}", (unsigned int)binSize);
+
+    const size_t jsonSize = align4(json.size());
+    const size_t total = 12 + 8 + jsonSize + (binSize > 0 ? 8 + binSize : 0);
+    if (total > 0xffffffffULL) {
+        setError("OCCTools::writeMeshGLB", "", "Mesh data to large for GLB");
+        return 0;
+    }
+
+    MeshFileWriter writer(filename);
+    if (!writer.ok) {
+        setError("OCCTools::writeMeshGLB", "", "Failed to open file");
+        return 0;
+    }
+
+    writer.putU32(0x46546C67); // glTF
+    writer.putU32(2);
+    writer.putU32(total);
+
+    writer.putU32(jsonSize);
+    writer.putU32(0x4E4F534A); // JSON
+    writer.put(json.data(), json.size());
+    writer.pad(jsonSize - json.size(), ' ');
+
+    if (binSize > 0) {
+        writer.putU32(binSize);
+        writer.putU32(0x004E4942); // BIN
+    }
+
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        const OCCMesh *mesh = meshes[i];
+        const GLBMeshLayout& info = layout[i];
+        const unsigned int nvertices = mesh->vertices.size();
+
+        for (unsigned int j = 0; j < nvertices; j++) {
+            const float *v = &mesh->vertices[j].x;
+            if (quantize) {
+                for (int k = 0; k < 3; k++)
+                    writer.putU16((unsigned int)quantizePosition(info, k, v[k]) & 0xffff);
+                writer.putU16(0);
+            } else {
+                writer.putF32(v[0]); writer.putF32(v[1]); writer.putF32(v[2]);
+            }
+        }
+
+        for (unsigned int j = 0; j < nvertices; j++) {
+            const float *n = &mesh->normals[j].x;
+            if (quantize) {
+                // normals are transformed with the inverse transpose of
+                // the node scale, so the stored normal is scaled with it.
+                float sn[3];
+                float len = 0.f;
+                for (int k = 0; k < 3; k++) {
+                    sn[k] = n[k]*info.scale[k];
+                    len += sn[k]*sn[k];
+                }
+                len = sqrt(len);
+                if (len > 0.f) {
+                    sn[0] /= len; sn[1] /= len; sn[2] /= len;
+                }
+                writer.putU8((unsigned char)quantizeUnit(sn[0]));
+                writer.putU8((unsigned char)quantizeUnit(sn[1]));
+                writer.putU8((unsigned char)quantizeUnit(sn[2]));
+                writer.putU8(0);
+            } else {
+                writer.putF32(n[0]); writer.putF32(n[1]); writer.putF32(n[2]);
+            }
+        }
+
+        const size_t nindices = 3*mesh->triangles.size();
+        for (unsigned int j = 0; j < mesh->triangles.size(); j++) {
+            const OCCStruct3I& t = mesh->triangles[j];
+            if (info.indexSize == 2) {
+                writer.putU16(t.i); writer.putU16(t.j); writer.putU16(t.k);
+            } else {
+                writer.putU32(t.i); writer.putU32(t.j); writer.putU32(t.k);
+            }
+        }
+        writer.pad(info.end - info.indexOffset - nindices*info.indexSize, 0);
+    }
+
+    if (!writer.close()) {
+        setError("OCCTools::writeMeshGLB", "", "Failed to write GLB file");
+        return 0;
+    }
+    return 1;
+}
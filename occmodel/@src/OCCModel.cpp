@@ -2,10 +2,120 @@
 // See LICENSE.txt for details on conditions.
 #include "OCCModel.h"
 
-char errorMessage[256];
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static OCC_THREAD_LOCAL OCCErrorInfo lastError;
+
+static void copyString(char *dst, const char *src, size_t size) {
+    if (src == NULL) src = "";
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = '\0';
+}
 
 void setErrorMessage(const char *err) {
-    strncpy(errorMessage, err, 255);
+    setError("", "", err);
+}
+
+void setError(const char *operation, const char *type, const char *message) {
+    copyString(lastError.operation, operation, sizeof(lastError.operation));
+    copyString(lastError.type, type, sizeof(lastError.type));
+    copyString(lastError.message, message, sizeof(lastError.message));
+}
+
+// Restore error state copied from another thread
+void setError(const OCCErrorInfo& info) {
+    setError(info.operation, info.type, info.message);
+}
+
+// Set error from the OCC exception currently handled. Must be
+// called from inside the catch block.
+void setFailure(const char *operation, const char *defaultMessage) {
+    Handle_Standard_Failure e = Standard_Failure::Caught();
+    if (e.IsNull()) {
+        setError(operation, "", defaultMessage);
+        return;
+    }
+    
+    const Standard_CString msg = e->GetMessageString();
+    if (msg != NULL && strlen(msg) > 1) {
+        setError(operation, e->DynamicType()->Name(), msg);
+    } else {
+        setError(operation, e->DynamicType()->Name(), defaultMessage);
+    }
+}
+
+char *getErrorMessage() {
+    return lastError.message;
+}
+
+OCCErrorInfo *getErrorInfo() {
+    return &lastError;
+}
+
+int numThreads() {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return std::max(1, (int)info.dwNumberOfProcessors);
+#else
+    return std::max(1, (int)sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+}
+
+struct ParallelJob {
+    OCCParallelFunction func;
+    void *data;
+    int count;
+    int next;
+    Standard_Mutex mutex;
+};
+
+static Standard_Address parallelWorker(Standard_Address arg) {
+    ParallelJob *job = (ParallelJob *)arg;
+    for (;;) {
+        int index;
+        {
+            Standard_Mutex::Sentry sentry(job->mutex);
+            index = job->next++;
+        }
+        if (index >= job->count)
+            break;
+        job->func(job->data, index);
+    }
+    return NULL;
+}
+
+void parallelFor(int count, OCCParallelFunction func, void *data, int threads) {
+    if (threads <= 0)
+        threads = numThreads();
+    threads = std::min(threads, count);
+    
+    ParallelJob job;
+    job.func = func;
+    job.data = data;
+    job.count = count;
+    job.next = 0;
+    
+    if (threads <= 1) {
+        parallelWorker(&job);
+        return;
+    }
+    
+    std::vector<OSD_Thread> workers(threads - 1, OSD_Thread(parallelWorker));
+    for (unsigned int i = 0; i < workers.size(); i++)
+        workers[i].Run(&job);
+    
+    parallelWorker(&job);
+    
+    for (unsigned int i = 0; i < workers.size(); i++)
+        workers[i].Wait();
 }
 
 // UTF-8 decoder
@@ -44,147 +154,230 @@ unsigned int decutf8(unsigned int* state, unsigned int* codep, unsigned int byte
 
 int OCCMesh::extractFaceMesh(const TopoDS_Face& face, bool qualityNormals = false)
 {
-    int vsize = this->vertices.size();
-    std::vector<gp_Vec> normals;
+    return this->extractFaces(std::vector<TopoDS_Face>(1, face), qualityNormals, false);
+}
+
+// Normal of surface at (u, v). Planes, cylinders, cones and spheres
+// are evaluated directly, other surfaces through props. Return false
+// where the normal is not defined.
+static bool surfaceNormal(const BRepAdaptor_Surface& surf, BRepLProp_SLProps& props,
+                          double u, double v, gp_Dir& normal)
+{
+    switch (surf.GetType()) {
+        case GeomAbs_Plane:
+        {
+            const gp_Ax3 pos = surf.Plane().Position();
+            normal = pos.XDirection().Crossed(pos.YDirection());
+            return true;
+        }
+        case GeomAbs_Cylinder:
+        {
+            // Du x Dv with Dv along the axis
+            const gp_Ax3 pos = surf.Cylinder().Position();
+            gp_Vec du = -sin(u)*gp_Vec(pos.XDirection()) + cos(u)*gp_Vec(pos.YDirection());
+            normal = gp_Dir(du.Crossed(gp_Vec(pos.Direction())));
+            return true;
+        }
+        case GeomAbs_Cone:
+        {
+            const gp_Cone cone = surf.Cone();
+            const gp_Ax3 pos = cone.Position();
+            const double ang = cone.SemiAngle();
+            const double r = cone.RefRadius() + v*sin(ang);
+            if (fabs(r) < gp::Resolution())
+                // apex
+                return false;
+            
+            gp_Vec dx(pos.XDirection()), dy(pos.YDirection());
+            gp_Vec du = -sin(u)*dx + cos(u)*dy;
+            gp_Vec dv = sin(ang)*(cos(u)*dx + sin(u)*dy) + cos(ang)*gp_Vec(pos.Direction());
+            gp_Vec n = du.Crossed(dv);
+            if (r < 0.)
+                n.Reverse();
+            normal = gp_Dir(n);
+            return true;
+        }
+        case GeomAbs_Sphere:
+        {
+            // radial direction, flipped for left handed placement
+            const gp_Ax3 pos = surf.Sphere().Position();
+            gp_Vec n = cos(v)*(cos(u)*gp_Vec(pos.XDirection()) + sin(u)*gp_Vec(pos.YDirection())) +
+                       sin(v)*gp_Vec(pos.Direction());
+            if (!pos.Direct())
+                n.Reverse();
+            normal = gp_Dir(n);
+            return true;
+        }
+        default:
+            props.SetParameters(u, v);
+            if (!props.IsNormalDefined())
+                return false;
+            normal = props.Normal();
+            return true;
+    }
+}
+
+int OCCMesh::fillFaceMesh(const TopoDS_Face& face, unsigned int voffset,
+                          unsigned int toffset, bool qualityNormals)
+{
+    int count = 0;
     bool reversed = false;
-    OCCStruct3f vert;
     OCCStruct3f norm;
     OCCStruct3I tri;
     
     try {
-        if(face.IsNull())
-            StdFail_NotDone::Raise("Face is Null");
-    
         TopLoc_Location loc;
         Handle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
         
-        if(triangulation.IsNull())
-            StdFail_NotDone::Raise("No triangulation created");
+        const int nnodes = triangulation->NbNodes();
+        const int ntris = triangulation->NbTriangles();
+        
+        // Normal sums and the node coordinates for the normal kernels
+        // are kept as separate x, y, z arrays. The normals are found in
+        // the frame of the triangulation, relative to the first node
+        // to keep float precision for faces far from the origin, and
+        // rotated by the location when done.
+        std::vector<float> px(nnodes), py(nnodes), pz(nnodes);
+        std::vector<float> vnx(nnodes, 0.f), vny(nnodes, 0.f), vnz(nnodes, 0.f);
         
         gp_Trsf tr = loc;
         const TColgp_Array1OfPnt& narr = triangulation->Nodes();
-        for (int i = 1; i <= triangulation->NbNodes(); i++)
+        const gp_XYZ origin = nnodes > 0 ? narr(1).XYZ() : gp_XYZ();
+        for (int i = 0; i < nnodes; i++)
         {
             Standard_Real x,y,z;
-            const gp_Pnt& pnt = narr(i);
+            const gp_Pnt& pnt = narr(i + 1);
             x = pnt.X();
             y = pnt.Y();
             z = pnt.Z();
-            tr.Transforms(x,y,z);
+            px[i] = (float)(x - origin.X());
+            py[i] = (float)(y - origin.Y());
+            pz[i] = (float)(z - origin.Z());
             
+            tr.Transforms(x,y,z);
+            OCCStruct3f& vert = this->vertices[voffset + i];
             vert.x = (float)x;
             vert.y = (float)y;
             vert.z = (float)z;
-            this->vertices.push_back(vert);
-            
-            // ensure we have normals for all vertices
-            norm.x = 0.f;
-            norm.y = 0.f;
-            norm.z = 0.f;
-            this->normals.push_back(norm);
-            
-            if (!qualityNormals)
-                normals.push_back(gp_Vec(0.0,0.0,0.0));
         }
         
         if (face.Orientation() == TopAbs_REVERSED)
             reversed = true;
         
+        std::vector<unsigned int> indices(3*ntris);
         const Poly_Array1OfTriangle& triarr = triangulation->Triangles();
-        for (int i = 1; i <= triangulation->NbTriangles(); i++)
+        for (int i = 0; i < ntris; i++)
         {
-            Poly_Triangle pt = triarr(i);
             Standard_Integer n1,n2,n3;
             
             if(reversed)
-                pt.Get(n2,n1,n3);
+                triarr(i + 1).Get(n2,n1,n3);
             else
-                pt.Get(n1,n2,n3);
+                triarr(i + 1).Get(n1,n2,n3);
             
-            // make sure that we don't process invalid triangle
-            if (n1 == n2 || n2 == n3 || n3 == n1)
-                continue;
-                
-            // Calculate face normal
-            const gp_Pnt& P1 = narr(n1);
-            const gp_Pnt& P2 = narr(n2);
-            const gp_Pnt& P3 = narr(n3);
-            
-            gp_Vec V1(P3.X() - P1.X(), P3.Y() - P1.Y(), P3.Z() - P1.Z());
-            if (V1.SquareMagnitude() < 1.0e-10)
-                // Degenerated triangle
-                continue;
-            
-            gp_Vec V2(P2.X() - P1.X(), P2.Y() - P1.Y(), P2.Z() - P1.Z());
-            if (V2.SquareMagnitude() < 1.0e-10)
-                // Degenerated triangle
-                continue;
-            
-            gp_Vec normal = V1.Crossed(V2);
-            if (normal.SquareMagnitude() < 1.0e-10)
-                // Degenerated triangle
+            indices[3*i] = n1 - 1;
+            indices[3*i + 1] = n2 - 1;
+            indices[3*i + 2] = n3 - 1;
+        }
+        
+        // Sum up area weighted face normals and flag degenerated
+        // triangles, including triangles with repeated vertices.
+        std::vector<unsigned char> valid(ntris);
+        if (ntris > 0)
+            accumulateNormals(&px[0], &py[0], &pz[0], &indices[0], ntris,
+                              &vnx[0], &vny[0], &vnz[0], &valid[0]);
+        
+        for (int i = 0; i < ntris; i++)
+        {
+            if (!valid[i])
                 continue;
             
-            tri.i = vsize + n1 - 1;
-            tri.j = vsize + n2 - 1;
-            tri.k = vsize + n3 - 1;
-            this->triangles.push_back(tri);
-            
-            if (!qualityNormals) {
-                normals[n1 - 1] = normals[n1 - 1] - normal;
-                normals[n2 - 1] = normals[n2 - 1] - normal;
-                normals[n3 - 1] = normals[n3 - 1] - normal;
+            tri.i = voffset + indices[3*i];
+            tri.j = voffset + indices[3*i + 1];
+            tri.k = voffset + indices[3*i + 2];
+            this->triangles[toffset + count++] = tri;
+        }
+        
+        // Normalize vertex normals
+        if (nnodes > 0)
+            normalizeNormals(&vnx[0], &vny[0], &vnz[0], nnodes);
+        
+        if (!loc.IsIdentity()) {
+            const gp_Mat& rot = tr.HVectorialPart();
+            for (int i = 0; i < nnodes; i++)
+            {
+                gp_XYZ n(vnx[i], vny[i], vnz[i]);
+                n.Multiply(rot);
+                vnx[i] = (float)n.X();
+                vny[i] = (float)n.Y();
+                vnz[i] = (float)n.Z();
             }
         }
         
         if (qualityNormals) {
-            Handle_Geom_Surface surface = BRep_Tool::Surface(face);
-            gp_Vec normal;
-            for (int i = 0; i < triangulation->NbNodes(); i++)
+            // Replace with the surface normal at the node parameters.
+            // The mesh normal is kept where it is not defined. The
+            // surface is evaluated with the location of the face.
+            BRepAdaptor_Surface surf(face, Standard_True);
+            BRepLProp_SLProps props(surf, 1, gp::Resolution());
+            
+            GeomAPI_ProjectPointOnSurf projector;
+            const bool hasUV = triangulation->HasUVNodes() == Standard_True;
+            if (!hasUV) {
+                Standard_Real umin, umax, vmin, vmax;
+                BRepTools::UVBounds(face, umin, umax, vmin, vmax);
+                projector.Init(BRep_Tool::Surface(face), umin, umax, vmin, vmax);
+            }
+            
+            gp_Dir normal;
+            for (int i = 0; i < nnodes; i++)
             {
-                vert = this->vertices[vsize + i];
-                gp_Pnt vertex(vert.x, vert.y, vert.z);
-                GeomAPI_ProjectPointOnSurf SrfProp(vertex, surface);
                 Standard_Real fU, fV;
-                SrfProp.Parameters(1, fU, fV);
-
-                GeomLProp_SLProps faceprop(surface, fU, fV, 2, gp::Resolution());
-                normal = faceprop.Normal();
-                
-                if (normal.SquareMagnitude() > 1.0e-10)
-                    normal.Normalize();
-                
-                if (reversed) {
-                    norm.x = (float)-normal.X();
-                    norm.y = (float)-normal.Y();
-                    norm.z = (float)-normal.Z();
+                if (hasUV) {
+                    const gp_Pnt2d& uv = triangulation->UVNodes()(i + 1);
+                    fU = uv.X();
+                    fV = uv.Y();
                 } else {
-                    norm.x = (float)normal.X();
-                    norm.y = (float)normal.Y();
-                    norm.z = (float)normal.Z();
+                    projector.Perform(narr(i + 1).Transformed(tr));
+                    if (!projector.IsDone() || projector.NbPoints() == 0)
+                        continue;
+                    projector.LowerDistanceParameters(fU, fV);
                 }
-                this->normals[vsize + i] = norm;
-            }
-        } else {
-            // Normalize vertex normals
-            for (int i = 0; i < triangulation->NbNodes(); i++)
-            {
-                gp_Vec normal = normals[i];
-                if (normal.SquareMagnitude() > 1.0e-10)
-                    normal.Normalize();
                 
-                norm.x = (float)normal.X();
-                norm.y = (float)normal.Y();
-                norm.z = (float)normal.Z();
-                this->normals[vsize + i] = norm;
+                if (!surfaceNormal(surf, props, fU, fV, normal))
+                    continue;
+                
+                if (reversed)
+                    normal.Reverse();
+                
+                vnx[i] = (float)normal.X();
+                vny[i] = (float)normal.Y();
+                vnz[i] = (float)normal.Z();
             }
         }
         
-        // extract edge indices from mesh
-        std::set<int> seen;
-        for (unsigned int i = 0; i < this->edgehash.size(); i++)
-            seen.insert(this->edgehash[i]);
+        for (int i = 0; i < nnodes; i++)
+        {
+            norm.x = vnx[i];
+            norm.y = vny[i];
+            norm.z = vnz[i];
+            this->normals[voffset + i] = norm;
+        }
+    } catch(Standard_Failure &err) {
+        setFailure("OCCMesh::fillFaceMesh", "Failed to mesh object");
+        return -1;
+    }
+    
+    return count;
+}
+
+int OCCMesh::extractFaceEdges(const TopoDS_Face& face, unsigned int voffset)
+{
+    try {
+        TopLoc_Location loc;
+        Handle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
         
+        // extract edge indices from mesh
         int lastSize = this->edgeindices.size();
         TopExp_Explorer ex0, ex1;
         for (ex0.Init(face, TopAbs_WIRE); ex0.More(); ex0.Next()) {
@@ -200,20 +393,19 @@ int OCCMesh::extractFaceMesh(const TopoDS_Face& face, bool qualityNormals = fals
                 if (BRep_Tool::IsClosed(edge, face))
                     continue;
                     
-                int hash = edge.HashCode(std::numeric_limits<int>::max());
-                if (seen.count(hash) == 0) {
+                if (!this->edgeset.contains(edge)) {
                     Handle(Poly_PolygonOnTriangulation) edgepoly = BRep_Tool::PolygonOnTriangulation(edge, triangulation, loc);
                     if (edgepoly.IsNull()) {
                         continue;
                     }
-                    seen.insert(hash);
-                    this->edgehash.push_back(hash);
+                    this->edgeset.add(edge);
+                    this->edgehash.push_back(edge.HashCode(std::numeric_limits<int>::max()));
                     this->edgeranges.push_back(this->edgeindices.size());
                     
                     const TColStd_Array1OfInteger& edgeind = edgepoly->Nodes();
                     for (int i=edgeind.Lower();i <= edgeind.Upper();i++) {
                         const unsigned int idx = (unsigned int)edgeind(i);
-                        this->edgeindices.push_back(vsize + idx - 1);
+                        this->edgeindices.push_back(voffset + idx - 1);
                     }
                     
                     this->edgeranges.push_back(this->edgeindices.size() - lastSize);
@@ -221,18 +413,274 @@ int OCCMesh::extractFaceMesh(const TopoDS_Face& face, bool qualityNormals = fals
                 }
             }
         }
-        
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
+        setFailure("OCCMesh::extractFaceEdges", "Failed to extract edges");
+        return 0;
+    }
+    
+    return 1;
+}
+
+// Hash of shape identity as compared by IsSame, the TShape and the
+// location. Located instances of one shape land in different buckets.
+static inline size_t shapeHash(const TopoDS_Shape& shape) {
+    size_t h = (size_t)shape.TShape().operator->();
+    h ^= (size_t)shape.Location().HashCode(IntegerLast())*0x85EBCA6Bu;
+    h ^= h >> 17;
+    h *= 0x9E3779B1u;
+    h ^= h >> 13;
+    return h;
+}
+
+bool OCCShapeSet::contains(const TopoDS_Shape& shape) const {
+    if (shapes.empty())
+        return false;
+    
+    const size_t mask = table.size() - 1;
+    for (size_t i = shapeHash(shape) & mask;; i = (i + 1) & mask) {
+        const int idx = table[i];
+        if (idx < 0)
+            return false;
+        if (shapes[idx].IsSame(shape))
+            return true;
+    }
+}
+
+bool OCCShapeSet::add(const TopoDS_Shape& shape) {
+    // keep load factor below 1/2
+    if (2*(shapes.size() + 1) > table.size()) {
+        std::vector<int> old(std::max((size_t)16, 2*table.size()), -1);
+        table.swap(old);
+        const size_t mask = table.size() - 1;
+        for (unsigned int j = 0; j < shapes.size(); j++) {
+            size_t i = shapeHash(shapes[j]) & mask;
+            while (table[i] >= 0)
+                i = (i + 1) & mask;
+            table[i] = j;
+        }
+    }
+    
+    const size_t mask = table.size() - 1;
+    size_t i = shapeHash(shape) & mask;
+    for (; table[i] >= 0; i = (i + 1) & mask) {
+        if (shapes[table[i]].IsSame(shape))
+            return false;
+    }
+    table[i] = shapes.size();
+    shapes.push_back(shape);
+    return true;
+}
+
+void OCCShapeSet::clear() {
+    shapes.clear();
+    table.clear();
+}
+
+// Order boxes by their centre along one axis
+struct BoxCentreLess {
+    const std::vector<double> *centres;
+    int axis;
+    bool operator()(int a, int b) const {
+        return (*centres)[3*a + axis] < (*centres)[3*b + axis];
+    }
+};
+
+OCCBoxTree::OCCBoxTree(const std::vector<Bnd_Box>& boxes)
+    : boxes(boxes)
+{
+    const int n = boxes.size();
+    centres.resize(3*n);
+    for (int i = 0; i < n; i++) {
+        // void boxes never overlap and are left out
+        if (boxes[i].IsVoid())
+            continue;
+        Standard_Real xmin, ymin, zmin, xmax, ymax, zmax;
+        boxes[i].Get(xmin, ymin, zmin, xmax, ymax, zmax);
+        centres[3*i] = .5*(xmin + xmax);
+        centres[3*i + 1] = .5*(ymin + ymax);
+        centres[3*i + 2] = .5*(zmin + zmax);
+        index.push_back(i);
+    }
+    if (!index.empty())
+        build(0, index.size());
+}
+
+int OCCBoxTree::build(int start, int count)
+{
+    const int id = nodes.size();
+    nodes.push_back(Node());
+    
+    Bnd_Box box;
+    for (int i = start; i < start + count; i++)
+        box.Add(boxes[index[i]]);
+    nodes[id].box = box;
+    
+    if (count <= leafSize) {
+        nodes[id].start = start;
+        nodes[id].count = count;
+        nodes[id].left = nodes[id].right = -1;
+        return id;
+    }
+    
+    // median split along longest axis
+    Standard_Real xmin, ymin, zmin, xmax, ymax, zmax;
+    box.Get(xmin, ymin, zmin, xmax, ymax, zmax);
+    BoxCentreLess less;
+    less.centres = &centres;
+    less.axis = 0;
+    if (ymax - ymin > xmax - xmin)
+        less.axis = 1;
+    if (zmax - zmin > std::max(xmax - xmin, ymax - ymin))
+        less.axis = 2;
+    
+    const int half = count/2;
+    std::nth_element(index.begin() + start, index.begin() + start + half,
+                     index.begin() + start + count, less);
+    
+    const int left = build(start, half);
+    const int right = build(start + half, count - half);
+    nodes[id].start = start;
+    nodes[id].count = count;
+    nodes[id].left = left;
+    nodes[id].right = right;
+    return id;
+}
+
+void OCCBoxTree::overlapping(const Bnd_Box& box, std::vector<int>& result) const
+{
+    if (nodes.empty() || box.IsVoid())
+        return;
+    
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        
+        if (node.box.IsOut(box))
+            continue;
+        
+        if (node.left < 0) {
+            for (int i = node.start; i < node.start + node.count; i++) {
+                if (!boxes[index[i]].IsOut(box))
+                    result.push_back(index[i]);
+            }
         } else {
-            setErrorMessage("Failed to mesh object");
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+struct FillFacesJob {
+    OCCMesh *mesh;
+    const std::vector<TopoDS_Face> *faces;
+    const std::vector<unsigned int> *voffset;
+    const std::vector<unsigned int> *toffset;
+    std::vector<int> *tcount;
+    std::vector<OCCErrorInfo> *errors;
+    bool qualityNormals;
+};
+
+static void fillFaceTask(void *data, int index) {
+    FillFacesJob *job = (FillFacesJob *)data;
+    (*job->tcount)[index] = job->mesh->fillFaceMesh((*job->faces)[index],
+                                                    (*job->voffset)[index],
+                                                    (*job->toffset)[index],
+                                                    job->qualityNormals);
+    // error state of the workers is thread local
+    if ((*job->tcount)[index] < 0)
+        (*job->errors)[index] = *getErrorInfo();
+}
+
+int OCCMesh::extractFaces(const std::vector<TopoDS_Face>& faces, bool qualityNormals,
+                          bool parallel = false)
+{
+    const unsigned int nfaces = faces.size();
+    std::vector<unsigned int> voffset(nfaces + 1), toffset(nfaces + 1);
+    std::vector<int> tcount(nfaces, 0);
+    std::vector<TopoDS_Face> meshed;
+    
+    // First pass sums up the size of all face triangulations,
+    // such that the mesh arrays are allocated once and each face
+    // is filled in place.
+    try {
+        voffset[0] = this->vertices.size();
+        toffset[0] = this->triangles.size();
+        for (unsigned int i = 0; i < nfaces; i++) {
+            const TopoDS_Face& face = faces[i];
+            if (face.IsNull())
+                continue;
+            
+            TopLoc_Location loc;
+            Handle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation(face, loc);
+            if (triangulation.IsNull())
+                continue;
+            
+            const unsigned int n = meshed.size();
+            meshed.push_back(face);
+            voffset[n + 1] = voffset[n] + triangulation->NbNodes();
+            toffset[n + 1] = toffset[n] + triangulation->NbTriangles();
         }
+    } catch(Standard_Failure &err) {
+        setFailure("OCCMesh::extractFaces", "Failed to mesh object");
         return 0;
     }
     
+    const unsigned int nmeshed = meshed.size();
+    if (nmeshed == 0) {
+        if (nfaces > 0)
+            setError("OCCMesh::extractFaces", "StdFail_NotDone", "No triangulation created");
+        return 0;
+    }
+    
+    this->vertices.resize(voffset[nmeshed]);
+    this->normals.resize(voffset[nmeshed]);
+    this->triangles.resize(toffset[nmeshed]);
+    
+    // a face which fails leaves the mesh incomplete
+    if (parallel) {
+        std::vector<OCCErrorInfo> errors(nmeshed);
+        FillFacesJob job;
+        job.mesh = this;
+        job.faces = &meshed;
+        job.voffset = &voffset;
+        job.toffset = &toffset;
+        job.tcount = &tcount;
+        job.errors = &errors;
+        job.qualityNormals = qualityNormals;
+        parallelFor(nmeshed, fillFaceTask, &job);
+        
+        for (unsigned int i = 0; i < nmeshed; i++) {
+            if (tcount[i] < 0) {
+                setError(errors[i]);
+                return 0;
+            }
+        }
+    } else {
+        for (unsigned int i = 0; i < nmeshed; i++) {
+            tcount[i] = this->fillFaceMesh(meshed[i], voffset[i], toffset[i], qualityNormals);
+            if (tcount[i] < 0)
+                return 0;
+        }
+    }
+    
+    // close the gaps left by degenerated triangles
+    unsigned int tsize = toffset[0];
+    for (unsigned int i = 0; i < nmeshed; i++) {
+        if (tsize != toffset[i])
+            std::copy(this->triangles.begin() + toffset[i],
+                      this->triangles.begin() + toffset[i] + tcount[i],
+                      this->triangles.begin() + tsize);
+        tsize += tcount[i];
+    }
+    this->triangles.resize(tsize);
+    
+    // edges are shared between faces and extracted in face order
+    for (unsigned int i = 0; i < nmeshed; i++) {
+        if (!this->extractFaceEdges(meshed[i], voffset[i]))
+            return 0;
+    }
+    
     return 1;
 }
 
@@ -241,183 +689,399 @@ void OCCMesh::optimize() {
     MeshOptimizer::optimizeIndexOrder(this);
     //printf("calcCacheEfficiency2 = %f\n\n", MeshOptimizer::calcCacheEfficiency(this));
 }
-        
-void OptVertex::updateScore(int cacheIndex)
+
+// Mesh cache. The entries keep a handle to the shape, such that the
+// TShape pointer used in the key stays valid and can not be reused by
+// a new shape while the entry exists.
+struct MeshCacheKey {
+    size_t tshape;
+    int location;
+    double factor;
+    double angle;
+    bool qualityNormals;
+    
+    bool operator<(const MeshCacheKey& other) const {
+        if (tshape != other.tshape) return tshape < other.tshape;
+        if (location != other.location) return location < other.location;
+        if (factor != other.factor) return factor < other.factor;
+        if (angle != other.angle) return angle < other.angle;
+        return qualityNormals < other.qualityNormals;
+    }
+};
+
+struct MeshCacheEntry {
+    MeshCacheKey key;
+    TopoDS_Shape shape;
+    OCCMesh *mesh;
+    size_t size;
+};
+
+typedef std::list<MeshCacheEntry> MeshCacheList;
+typedef std::multimap<MeshCacheKey, MeshCacheList::iterator> MeshCacheMap;
+
+static Standard_Mutex cacheMutex;
+static MeshCacheList cacheList;   // most recently used first
+static MeshCacheMap cacheMap;
+static size_t cacheBudget = 0;
+static size_t cacheSize = 0;
+static size_t cacheHits = 0;
+static size_t cacheMisses = 0;
+
+static MeshCacheKey meshCacheKey(const TopoDS_Shape& shape, double factor,
+                                 double angle, bool qualityNormals)
+{
+    MeshCacheKey key;
+    key.tshape = (size_t)shape.TShape().operator->();
+    key.location = shape.Location().HashCode(std::numeric_limits<int>::max());
+    key.factor = factor;
+    key.angle = angle;
+    key.qualityNormals = qualityNormals;
+    return key;
+}
+
+static size_t meshSize(const OCCMesh *mesh)
+{
+    return sizeof(OCCMesh) +
+           mesh->vertices.capacity()*sizeof(OCCStruct3f) +
+           mesh->normals.capacity()*sizeof(OCCStruct3f) +
+           mesh->triangles.capacity()*sizeof(OCCStruct3I) +
+           mesh->edgeindices.capacity()*sizeof(unsigned int) +
+           mesh->edgeranges.capacity()*sizeof(int) +
+           mesh->edgehash.capacity()*sizeof(int) +
+           mesh->edgeset.shapes.capacity()*(sizeof(TopoDS_Shape) + sizeof(int));
+}
+
+static MeshCacheMap::iterator findEntry(const MeshCacheKey& key, const TopoDS_Shape& shape)
 {
-	if(faces.empty())
-	{	
-		score = 0;
-		return;
-	}
-	
-	// The constants used here are coming from the paper
-	if(cacheIndex < 0) score = 0;				// Not in cache
-	else if(cacheIndex < 3) score = 0.75f;	// Among three most recent vertices
-	else score = pow(1.0f - ((cacheIndex - 3) / MeshOptimizer::maxCacheSize), 1.5f);
+    // location hash may collide, compare the full shape
+    std::pair<MeshCacheMap::iterator, MeshCacheMap::iterator> range = cacheMap.equal_range(key);
+    for (MeshCacheMap::iterator it = range.first; it != range.second; ++it) {
+        if (it->second->shape.IsEqual(shape))
+            return it;
+    }
+    return cacheMap.end();
+}
 
-	score += 2.0f * pow((float)faces.size(), -0.5f);
+static void evictEntries(size_t budget)
+{
+    while (cacheSize > budget && !cacheList.empty()) {
+        MeshCacheEntry& entry = cacheList.back();
+        std::pair<MeshCacheMap::iterator, MeshCacheMap::iterator> range = cacheMap.equal_range(entry.key);
+        for (MeshCacheMap::iterator it = range.first; it != range.second; ++it) {
+            if (it->second->mesh == entry.mesh) {
+                cacheMap.erase(it);
+                break;
+            }
+        }
+        cacheSize -= entry.size;
+        delete entry.mesh;
+        cacheList.pop_back();
+    }
 }
 
+OCCMesh *OCCMeshCache::find(const TopoDS_Shape& shape, double factor, double angle,
+                            bool qualityNormals)
+{
+    Standard_Mutex::Sentry sentry(cacheMutex);
+    if (cacheBudget == 0 || shape.IsNull())
+        return NULL;
+    
+    MeshCacheMap::iterator it = findEntry(meshCacheKey(shape, factor, angle, qualityNormals), shape);
+    if (it == cacheMap.end()) {
+        cacheMisses++;
+        return NULL;
+    }
+    
+    cacheHits++;
+    cacheList.splice(cacheList.begin(), cacheList, it->second);
+    return new OCCMesh(*it->second->mesh);
+}
+
+void OCCMeshCache::insert(const TopoDS_Shape& shape, double factor, double angle,
+                          bool qualityNormals, const OCCMesh *mesh)
+{
+    Standard_Mutex::Sentry sentry(cacheMutex);
+    if (cacheBudget == 0 || shape.IsNull() || mesh == NULL)
+        return;
+    
+    const size_t size = meshSize(mesh);
+    if (size > cacheBudget)
+        return;
+    
+    MeshCacheKey key = meshCacheKey(shape, factor, angle, qualityNormals);
+    if (findEntry(key, shape) != cacheMap.end())
+        return;
+    
+    evictEntries(cacheBudget - size);
+    
+    MeshCacheEntry entry;
+    entry.key = key;
+    entry.shape = shape;
+    entry.mesh = new OCCMesh(*mesh);
+    entry.size = size;
+    cacheList.push_front(entry);
+    cacheMap.insert(std::make_pair(key, cacheList.begin()));
+    cacheSize += size;
+}
+
+void OCCMeshCache::setBudget(size_t bytes)
+{
+    Standard_Mutex::Sentry sentry(cacheMutex);
+    cacheBudget = bytes;
+    evictEntries(cacheBudget);
+}
+
+void OCCMeshCache::clear()
+{
+    Standard_Mutex::Sentry sentry(cacheMutex);
+    evictEntries(0);
+    cacheHits = 0;
+    cacheMisses = 0;
+}
+
+OCCMeshCacheInfo OCCMeshCache::info()
+{
+    Standard_Mutex::Sentry sentry(cacheMutex);
+    OCCMeshCacheInfo ret;
+    ret.budget = cacheBudget;
+    ret.size = cacheSize;
+    ret.count = cacheList.size();
+    ret.hits = cacheHits;
+    ret.misses = cacheMisses;
+    return ret;
+}
+        
+// Score tables for the vertex cache optimisation. The constants used
+// are coming from the paper.
+static const unsigned int maxValenceScore = 32;
+
+struct OptScoreTable
+{
+    float cache[MeshOptimizer::maxCacheSize];
+    float valence[maxValenceScore];
+    
+    OptScoreTable() {
+        const float scaler = 1.0f / (MeshOptimizer::maxCacheSize - 3);
+        for (unsigned int i = 0; i < MeshOptimizer::maxCacheSize; ++i) {
+            if (i < 3)
+                // Among three most recent vertices
+                cache[i] = 0.75f;
+            else
+                cache[i] = powf(1.0f - (i - 3)*scaler, 1.5f);
+        }
+        valence[0] = 0.0f;
+        for (unsigned int i = 1; i < maxValenceScore; ++i)
+            valence[i] = 2.0f*powf((float)i, -0.5f);
+    }
+    
+    float score(int cacheIndex, unsigned int activeFaces) const {
+        if (activeFaces == 0)
+            return -1.0f;
+        
+        float ret = cacheIndex < 0 ? 0.0f : cache[cacheIndex];
+        if (activeFaces < maxValenceScore)
+            ret += valence[activeFaces];
+        else
+            ret += 2.0f*powf((float)activeFaces, -0.5f);
+        return ret;
+    }
+};
+
+static const OptScoreTable optScores;
+
 void MeshOptimizer::optimizeIndexOrder(OCCMesh *mesh)
 {
-	// Implementation of Linear-Speed Vertex Cache Optimisation by Tom Forsyth
-	// (see http://home.comcast.net/~tom_forsyth/papers/fast_vert_cache_opt.html)
-	const size_t nvertices = mesh->vertices.size();
-	const size_t nindices = mesh->triangles.size();
-	if(nindices == 0) return;
-    
-    std::vector<OptVertex> verts(nvertices);
-	std::set<OptFace *> faces;
-	std::list<OptVertex *> cache;
-    
-    // Build vertex and triangle structures
-	for(unsigned int i = 0; i < nindices; ++i)
-	{
-		std::set<OptFace *>::iterator itr1 = faces.insert(faces.begin(), new OptFace());
-		OptFace *face = (*itr1);
-		
-        const OCCStruct3I *tri = &mesh->triangles[i];
-		face->verts[0] = &verts[tri->i];
-		face->verts[1] = &verts[tri->j];
-		face->verts[2] = &verts[tri->k];
-		face->verts[0]->faces.insert(face);
-		face->verts[1]->faces.insert(face);
-		face->verts[2]->faces.insert(face);
-	}
-    for( unsigned int i = 0; i < nvertices; ++i )
-	{
-		verts[i].index = i;
-		verts[i].updateScore( -1 );
-	}
+    // Implementation of Linear-Speed Vertex Cache Optimisation by Tom Forsyth
+    // (see http://home.comcast.net/~tom_forsyth/papers/fast_vert_cache_opt.html)
+    //
+    // Vertex to face adjacency is stored as flat arrays (CSR). Faces
+    // are removed from the adjacency of a vertex by swapping them past
+    // the active range. When no face in the cache is left, candidates
+    // are taken from a stack of recently used vertices and as a last
+    // resort by a forward scan over the faces.
+    const unsigned int nvertices = mesh->vertices.size();
+    const unsigned int nfaces = mesh->triangles.size();
+    if(nfaces == 0) return;
+    
+    const std::vector<OCCStruct3I> input(mesh->triangles);
+    const unsigned int *indices = &input[0].i;
+    
+    // Build vertex to face adjacency
+    std::vector<unsigned int> activeFaces(nvertices, 0);
+    for (unsigned int i = 0; i < 3*nfaces; ++i)
+        activeFaces[indices[i]]++;
+    
+    std::vector<unsigned int> offsets(nvertices + 1, 0);
+    for (unsigned int i = 0; i < nvertices; ++i)
+        offsets[i + 1] = offsets[i] + activeFaces[i];
+    
+    std::vector<unsigned int> adjacency(3*nfaces);
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (unsigned int i = 0; i < nfaces; ++i) {
+        adjacency[fill[indices[3*i + 0]]++] = i;
+        adjacency[fill[indices[3*i + 1]]++] = i;
+        adjacency[fill[indices[3*i + 2]]++] = i;
+    }
+    
+    // Initial scores
+    std::vector<float> vertexScore(nvertices);
+    for (unsigned int i = 0; i < nvertices; ++i)
+        vertexScore[i] = optScores.score(-1, activeFaces[i]);
+    
+    std::vector<float> faceScore(nfaces);
+    for (unsigned int i = 0; i < nfaces; ++i) {
+        faceScore[i] = vertexScore[indices[3*i + 0]] +
+                       vertexScore[indices[3*i + 1]] +
+                       vertexScore[indices[3*i + 2]];
+    }
+    
+    std::vector<unsigned char> emitted(nfaces, 0);
+    std::vector<unsigned int> deadEnd;
+    deadEnd.reserve(3*nfaces);
+    
+    unsigned int cache[maxCacheSize + 3];
+    unsigned int newCache[maxCacheSize + 3];
+    unsigned int cacheSize = 0;
+    unsigned int scanCursor = 0;
+    
+    int bestFace = 0;
+    float bestScore = faceScore[0];
+    for (unsigned int i = 1; i < nfaces; ++i) {
+        if (faceScore[i] > bestScore) {
+            bestScore = faceScore[i];
+            bestFace = i;
+        }
+    }
     
     // Main loop of algorithm
-	unsigned int curIndex = 0;
-	
-    while( !faces.empty() )
-	{
-		OptFace *bestFace = 0x0;
-		float bestScore = -1.0f;
-		
-		// Try to find best scoring face in cache
-		std::list<OptVertex *>::iterator itr1 = cache.begin();
-		while(itr1 != cache.end())
-		{
-			std::set<OptFace *>::iterator itr2 = (*itr1)->faces.begin();
-			while(itr2 != (*itr1)->faces.end())
-			{
-				if((*itr2)->getScore() > bestScore)
-				{
-					bestFace = *itr2;
-					bestScore = bestFace->getScore();
-				}
-				++itr2;
-			}
-			++itr1;
-		}
-        
-        // If that didn't work find it in the complete list of triangles
-		if(bestFace == 0x0)
-		{
-			std::set<OptFace *>::iterator itr2 = faces.begin();
-			while(itr2 != faces.end())
-			{
-				if((*itr2)->getScore() > bestScore)
-				{
-					bestFace = (*itr2);
-					bestScore = bestFace->getScore();
-				}
-				++itr2;
-			}
-		}
+    for (unsigned int curIndex = 0; curIndex < nfaces; ++curIndex)
+    {
+        if (bestFace < 0) {
+            // Try recently used vertices with remaining faces
+            while (!deadEnd.empty() && bestFace < 0) {
+                const unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                
+                bestScore = -1.0f;
+                for (unsigned int j = 0; j < activeFaces[v]; ++j) {
+                    const unsigned int f = adjacency[offsets[v] + j];
+                    if (faceScore[f] > bestScore) {
+                        bestScore = faceScore[f];
+                        bestFace = f;
+                    }
+                }
+            }
+            // Fall back to next unprocessed face in input order
+            if (bestFace < 0) {
+                while (emitted[scanCursor])
+                    scanCursor++;
+                bestFace = scanCursor;
+            }
+        }
         
         // Process vertices of best face
-        OCCStruct3I *tri = &mesh->triangles[curIndex++];
-        tri->i = bestFace->verts[0]->index;
-        tri->j = bestFace->verts[1]->index;
-        tri->k = bestFace->verts[2]->index;
+        const unsigned int *face = &indices[3*bestFace];
+        mesh->triangles[curIndex] = input[bestFace];
+        emitted[bestFace] = 1;
         
-		for( unsigned int i = 0; i < 3; ++i )
-		{
-			// Move vertex to head of cache
-			itr1 = find(cache.begin(), cache.end(), bestFace->verts[i]);
-			if(itr1 != cache.end() ) cache.erase( itr1);
-			cache.push_front(bestFace->verts[i]);
-
-			// Remove face from vertex lists
-			bestFace->verts[i]->faces.erase(bestFace);
-		}
+        for (unsigned int i = 0; i < 3; ++i) {
+            // Remove face from vertex adjacency
+            const unsigned int v = face[i];
+            unsigned int *adj = &adjacency[offsets[v]];
+            const unsigned int last = activeFaces[v] - 1;
+            for (unsigned int j = 0; j <= last; ++j) {
+                if (adj[j] == (unsigned int)bestFace) {
+                    adj[j] = adj[last];
+                    adj[last] = bestFace;
+                    break;
+                }
+            }
+            activeFaces[v] = last;
+            deadEnd.push_back(v);
+        }
         
-        // Remove best face
-		faces.erase(faces.find(bestFace));
-		delete bestFace;
+        // Move vertices of face to head of cache
+        unsigned int newSize = 0;
+        for (unsigned int i = 0; i < 3; ++i) {
+            const unsigned int v = face[i];
+            if (newSize > 0 && (newCache[0] == v || (newSize > 1 && newCache[1] == v)))
+                continue;
+            newCache[newSize++] = v;
+        }
+        for (unsigned int i = 0; i < cacheSize; ++i) {
+            const unsigned int v = cache[i];
+            if (v != face[0] && v != face[1] && v != face[2])
+                newCache[newSize++] = v;
+        }
         
-        // Update scores of vertices in cache
-		unsigned int cacheIndex = 0;
-		for(itr1 = cache.begin(); itr1 != cache.end(); ++itr1)
-		{
-			(*itr1)->updateScore( cacheIndex++ );
-		}
-
-		// Trim cache
-		for(unsigned int i = cache.size(); i > maxCacheSize; --i)
-		{
-			cache.pop_back();
-		}
+        // Update scores of vertices in cache and vertices pushed out
+        for (unsigned int i = 0; i < newSize; ++i) {
+            const unsigned int v = newCache[i];
+            const int pos = i < maxCacheSize ? (int)i : -1;
+            
+            const float score = optScores.score(pos, activeFaces[v]);
+            const float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+            
+            for (unsigned int j = 0; j < activeFaces[v]; ++j)
+                faceScore[adjacency[offsets[v] + j]] += delta;
+        }
+        
+        // Trim cache
+        cacheSize = newSize < maxCacheSize ? newSize : maxCacheSize;
+        
+        // Best face in cache, once all scores are up to date
+        bestFace = -1;
+        bestScore = -1.0f;
+        for (unsigned int i = 0; i < cacheSize; ++i) {
+            const unsigned int v = newCache[i];
+            for (unsigned int j = 0; j < activeFaces[v]; ++j) {
+                const unsigned int f = adjacency[offsets[v] + j];
+                if (faceScore[f] > bestScore) {
+                    bestScore = faceScore[f];
+                    bestFace = f;
+                }
+            }
+        }
+        for (unsigned int i = 0; i < cacheSize; ++i)
+            cache[i] = newCache[i];
     }
     
-    // Remap vertices to make access to them as linear as possible
-	std::map<unsigned int, unsigned int> mapping;
-	unsigned int curVertex = 0;
+    // Remap vertices to make access to them as linear as possible.
+    // Vertices not referenced by any triangle are kept at the end.
+    std::vector<int> mapping(nvertices, -1);
+    unsigned int curVertex = 0;
     
-    for(unsigned int i = 0; i < nindices; ++i)
-	{
+    for (unsigned int i = 0; i < nfaces; ++i)
+    {
         OCCStruct3I *tri = &mesh->triangles[i];
         
-        std::map<unsigned int, unsigned int>::iterator itr1 = mapping.find(tri->i);
-		if(itr1 == mapping.end())
-		{
-			mapping[tri->i] = curVertex;
-			tri->i = curVertex++;
-		}
-		else
-		{
-			tri->i = itr1->second;
-		}
+        if (mapping[tri->i] < 0) mapping[tri->i] = curVertex++;
+        tri->i = mapping[tri->i];
         
-        std::map<unsigned int, unsigned int>::iterator itr2 = mapping.find(tri->j);
-		if(itr2 == mapping.end())
-		{
-			mapping[tri->j] = curVertex;
-			tri->j = curVertex++;
-		}
-		else
-		{
-			tri->j = itr2->second;
-		}
+        if (mapping[tri->j] < 0) mapping[tri->j] = curVertex++;
+        tri->j = mapping[tri->j];
         
-        std::map<unsigned int, unsigned int>::iterator itr3 = mapping.find(tri->k);
-		if(itr3 == mapping.end())
-		{
-			mapping[tri->k] = curVertex;
-			tri->k = curVertex++;
-		}
-		else
-		{
-			tri->k = itr3->second;
-		}
+        if (mapping[tri->k] < 0) mapping[tri->k] = curVertex++;
+        tri->k = mapping[tri->k];
     }
     
-    std::vector<OCCStruct3f> oldVertices(mesh->vertices.begin(),  mesh->vertices.end());
-    std::vector<OCCStruct3f> oldNormals(mesh->normals.begin(), mesh->normals.end());    
-    for(std::map<unsigned int, unsigned int>::iterator itr1 = mapping.begin();
-        itr1 != mapping.end(); ++itr1 )
-	{
-		mesh->vertices[itr1->second] = oldVertices[itr1->first];
-		mesh->normals[itr1->second] = oldNormals[itr1->first];
-	}
+    for (unsigned int i = 0; i < nvertices; ++i) {
+        if (mapping[i] < 0) mapping[i] = curVertex++;
+    }
     
-    for(unsigned int i = 0; i < mesh->edgeindices.size(); ++i)
-	{
+    std::vector<OCCStruct3f> oldVertices(mesh->vertices);
+    for (unsigned int i = 0; i < nvertices; ++i)
+        mesh->vertices[mapping[i]] = oldVertices[i];
+    
+    if (mesh->normals.size() == nvertices) {
+        std::vector<OCCStruct3f> oldNormals(mesh->normals);
+        for (unsigned int i = 0; i < nvertices; ++i)
+            mesh->normals[mapping[i]] = oldNormals[i];
+    }
+    
+    for (unsigned int i = 0; i < mesh->edgeindices.size(); ++i)
+    {
         mesh->edgeindices[i] = mapping[mesh->edgeindices[i]];
     }
 }
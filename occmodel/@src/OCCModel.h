@@ -4,7 +4,9 @@
 #define OCCMODEL_H
 #include "OCCIncludes.h"
 #include <sstream>
+#include <fstream>
 #include <math.h>
+#include <string.h>
 #include <limits>
 #include <vector>
 #include <set>
@@ -12,6 +14,12 @@
 #include <list>
 #include <algorithm>
 
+#if defined(_MSC_VER)
+#define OCC_THREAD_LOCAL __declspec(thread)
+#else
+#define OCC_THREAD_LOCAL __thread
+#endif
+
 typedef std::vector<float> FVec;
 typedef std::vector<double> DVec;
 typedef std::vector<int> IVec;
@@ -34,29 +42,38 @@ struct OCCStruct3I {
     unsigned int k;
 };
 
-struct OptFace;
-
-struct OptVertex
-{
-	unsigned int           index;  // Index in vertex array
-	float                  score;
-	std::set<OptFace *>    faces;  // Faces that are using this vertex
-	void updateScore(int cacheIndex);
-};
-
-struct OptFace
-{
-	OptVertex  *verts[3];
-	float getScore()  {return verts[0]->score + verts[1]->score + verts[2]->score;}
-};
-
 enum BoolOpType {BOOL_FUSE, BOOL_CUT, BOOL_COMMON};
 
 class OCCBase;
 class OCCSolid;
 
-extern char errorMessage[256];
+// Error information of the last failed operation. The error
+// state is kept per thread and is valid until the next failure
+// in the same thread.
+struct OCCErrorInfo {
+    char operation[64];
+    char type[64];
+    char message[256];
+};
+
 void setErrorMessage(const char *err);
+void setError(const char *operation, const char *type, const char *message);
+void setFailure(const char *operation, const char *defaultMessage);
+void setError(const OCCErrorInfo& info);
+char *getErrorMessage();
+OCCErrorInfo *getErrorInfo();
+
+// Run func(data, index) for index in [0, count) on a pool of
+// threads. The calling thread takes part in the work. Functions
+// must not let exceptions escape.
+typedef void (*OCCParallelFunction)(void *data, int index);
+int numThreads();
+void parallelFor(int count, OCCParallelFunction func, void *data, int threads = 0);
+
+// Linear part of a 3x4 row major matrix: rotation, uniform scaling
+// possibly with mirroring, or general.
+enum MatrixType {MATRIX_RIGID, MATRIX_UNIFORM, MATRIX_GENERAL};
+MatrixType matrixType(const double *mat);
 
 class OCCTesselation {
     public:
@@ -65,6 +82,59 @@ class OCCTesselation {
         OCCTesselation() { ; }
 };
 
+// Set of shapes compared by IsSame, using open addressing on the
+// TShape identity. The shapes are kept in insertion order.
+class OCCShapeSet {
+    public:
+        std::vector<TopoDS_Shape> shapes;
+        OCCShapeSet() { ; }
+        bool contains(const TopoDS_Shape& shape) const;
+        bool add(const TopoDS_Shape& shape);
+        void clear();
+    private:
+        std::vector<int> table;
+};
+
+// Bounding volume hierarchy over boxes, split at the median along
+// the longest axis.
+class OCCBoxTree {
+    public:
+        OCCBoxTree(const std::vector<Bnd_Box>& boxes);
+        // Append index of boxes overlapping box to result
+        void overlapping(const Bnd_Box& box, std::vector<int>& result) const;
+    private:
+        static const int leafSize = 4;
+        struct Node {
+            Bnd_Box box;
+            int left, right;
+            int start, count;
+        };
+        std::vector<Node> nodes;
+        std::vector<int> index;
+        std::vector<double> centres;
+        const std::vector<Bnd_Box>& boxes;
+        int build(int start, int count);
+};
+
+// Kernels used for mesh normals. NORMALS_AUTO selects the fastest
+// kernel supported by the cpu.
+enum NormalKernel {NORMALS_AUTO, NORMALS_SCALAR, NORMALS_SSE, NORMALS_AVX2};
+bool setNormalKernel(NormalKernel kernel);
+NormalKernel getNormalKernel();
+
+// Add triangle normals (P2 - P1) x (P3 - P1) from separate coordinate
+// arrays to the normal sums of the vertices. Degenerated triangles are
+// flagged with 0 in valid and not added.
+void accumulateNormals(const float *x, const float *y, const float *z,
+                       const unsigned int *tri, int ntris,
+                       float *vnx, float *vny, float *vnz, unsigned char *valid);
+void normalizeNormals(float *nx, float *ny, float *nz, int n);
+
+// LZ4 style block compression. decompressBlock returns false on
+// corrupt input or if the output size does not match.
+void compressBlock(const char *input, size_t size, std::string& output);
+bool decompressBlock(const char *input, size_t size, char *output, size_t outsize);
+
 class OCCMesh {
     public:
         std::vector<OCCStruct3f> normals;
@@ -73,8 +143,17 @@ class OCCMesh {
         std::vector<unsigned int> edgeindices;
         std::vector<int> edgeranges;
         std::vector<int> edgehash;
+        OCCShapeSet edgeset;
         OCCMesh() { ; }
         int extractFaceMesh(const TopoDS_Face& face, bool qualityNormals);
+        int extractFaces(const std::vector<TopoDS_Face>& faces, bool qualityNormals,
+                         bool parallel);
+        // Fill face triangulation into the preallocated arrays at the
+        // given offsets. Return the number of triangles written or
+        // -1 on failure.
+        int fillFaceMesh(const TopoDS_Face& face, unsigned int voffset,
+                         unsigned int toffset, bool qualityNormals);
+        int extractFaceEdges(const TopoDS_Face& face, unsigned int voffset);
         void optimize();
 };
 
@@ -87,29 +166,194 @@ public:
 	static void optimizeIndexOrder(OCCMesh *mesh);
 };
 
+struct OCCMeshCacheInfo {
+    size_t budget;
+    size_t size;
+    size_t count;
+    size_t hits;
+    size_t misses;
+};
+
+// Least recently used cache of meshes keyed on shape identity,
+// location and meshing parameters. Meshes are returned as copies
+// owned by the caller. The cache is disabled with a budget of 0.
+class OCCMeshCache {
+public:
+    static OCCMesh *find(const TopoDS_Shape& shape, double factor, double angle,
+                         bool qualityNormals);
+    static void insert(const TopoDS_Shape& shape, double factor, double angle,
+                       bool qualityNormals, const OCCMesh *mesh);
+    static void setBudget(size_t bytes);
+    static void clear();
+    static OCCMeshCacheInfo info();
+};
+
 unsigned int decutf8(unsigned int* state, unsigned int* codep, unsigned int byte);
 
 void printShapeType(const TopoDS_Shape& shape);
+
+// Report for each shape extracted on import. index is the location
+// in the returned shapes or -1 if the shape was not valid and could
+// not be fixed. Times are given in seconds.
+// Import report of one shape. In trusted mode the shapes are not
+// checked and valid, fixed and the times are not set.
+struct OCCShapeReport {
+    TopAbs_ShapeEnum type;
+    int index;
+    bool checked;
+    bool valid;
+    bool fixed;
+    double checkTime;
+    double fixTime;
+};
+
+OCCBase *newShape(const TopoDS_Shape& shape);
 int extractSubShape(const TopoDS_Shape& shape, std::vector<OCCBase *>& shapes);
-int extractShape(const TopoDS_Shape& shape, std::vector<OCCBase *>& shapes);
+int extractShape(const TopoDS_Shape& shape, std::vector<OCCBase *>& shapes,
+                 std::vector<OCCShapeReport> *report = NULL);
+
+// Read only stream buffer over a memory block
+class OCCMemoryBuffer : public std::streambuf {
+public:
+    OCCMemoryBuffer(const char *data, size_t size) {
+        char *p = const_cast<char *>(data);
+        setg(p, p, p + size);
+    }
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which = std::ios_base::in) {
+        char *p;
+        if (dir == std::ios_base::beg)
+            p = eback() + off;
+        else if (dir == std::ios_base::cur)
+            p = gptr() + off;
+        else
+            p = egptr() + off;
+        if (p < eback() || p > egptr())
+            return pos_type(off_type(-1));
+        setg(eback(), p, egptr());
+        return pos_type(p - eback());
+    }
+    pos_type seekpos(pos_type pos,
+                     std::ios_base::openmode which = std::ios_base::in) {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+// Write only stream buffer over a memory block of fixed size. Writes
+// past the end fail.
+class OCCMemoryWriteBuffer : public std::streambuf {
+public:
+    OCCMemoryWriteBuffer(char *data, size_t size) {
+        setp(data, data + size);
+    }
+    size_t written() const { return pptr() - pbase(); }
+};
+
+// Stream buffer which only counts the bytes written to it
+class OCCCountingBuffer : public std::streambuf {
+public:
+    OCCCountingBuffer() : count(0) { ; }
+    size_t count;
+protected:
+    int_type overflow(int_type c) {
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+            count++;
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char *s, std::streamsize n) {
+        count += n;
+        return n;
+    }
+};
+
+// Returns memory of the given size to write to, or NULL after
+// setting the error.
+typedef char *(*OCCAllocateFunction)(size_t size, void *data);
+
+// Read only memory mapped file. With sequential the kernel is asked
+// to read ahead and prefetch the whole file.
+class OCCMappedFile {
+public:
+    OCCMappedFile() : data(NULL), size(0), handle(NULL) { ; }
+    ~OCCMappedFile() { close(); }
+    bool open(const char *filename, bool sequential);
+    void close();
+    const char *data;
+    size_t size;
+private:
+    void *handle;
+};
+
+// Job for OCCTools::exportMany. status, time in seconds and the
+// error message are set when the job has run.
+enum ExportFormat {EXPORT_BREP, EXPORT_BINARY, EXPORT_STEP, EXPORT_STL, EXPORT_VRML};
+
+struct OCCExportJob {
+    OCCBase *shape;
+    const char *filename;
+    ExportFormat format;
+    int status;
+    double time;
+    char message[256];
+};
 
 class OCCTools {
 public:
     static int writeBREP(const char *filename, std::vector<OCCBase *> shapes);
     static int writeBREP(std::ostream& str, const TopoDS_Shape& shape);
     static int writeSTEP(const char *filename, std::vector<OCCBase *> shapes);
+    static int writeSTEP(const char *filename, const TopoDS_Shape& shape, bool assembly);
     static int writeSTL(const char *filename, std::vector<OCCBase *> shapes);
     static int writeVRML(const char *filename, std::vector<OCCBase *> shapes);
-    static int readBREP(const char *filename, std::vector<OCCBase *>& shapes);
+    static int exportMany(std::vector<OCCExportJob>& jobs, int threads);
+    static int transformMany(std::vector<OCCBase *> shapes, const double *matrices,
+                             size_t n, int threads, bool share);
+    static int writeMeshSTL(const char *filename, std::vector<OCCMesh *> meshes);
+    static int writeMeshGLB(const char *filename, std::vector<OCCMesh *> meshes, bool quantize);
+    static int readBREP(const char *filename, std::vector<OCCBase *>& shapes,
+                        std::vector<OCCShapeReport> *report);
     static int readBREP(std::istream& str, TopoDS_Shape& shape);
-    static int readSTEP(const char *filename, std::vector<OCCBase *>& shapes);
+    static int writeBinary(std::string& output, const TopoDS_Shape& shape, bool compress);
+    static int writeBinary(const TopoDS_Shape& shape, OCCAllocateFunction allocate, void *data);
+    static int readBinary(const char *input, size_t size, TopoDS_Shape& shape);
+    static bool isBinary(const char *input, size_t size);
+    static int writeShared(const char *name, const TopoDS_Shape& shape, bool compress);
+    static int readShared(const char *name, TopoDS_Shape& shape);
+    static int removeShared(const char *name);
+    static int readSTEP(const char *filename, std::vector<OCCBase *>& shapes,
+                        std::vector<OCCShapeReport> *report, int threads);
+    static int readSTEP(const char *filename, TopoDS_Shape& shape);
+};
+
+// Read STEP file one root at a time. The transfer data of each root
+// is released before the shapes are handed out by next().
+class OCCStepReader {
+public:
+    OCCStepReader() : root(1), nroots(0), pos(0), failed(false) { ; }
+    ~OCCStepReader();
+    int open(const char *filename);
+    int numRoots() { return nroots; }
+    bool more() { return pos < pending.size() || root <= nroots; }
+    bool hasFailed() { return failed; }
+    OCCBase *next();
+private:
+    int transferRoot();
+    STEPControl_Reader reader;
+    int root;
+    int nroots;
+    unsigned int pos;
+    bool failed;
+    std::vector<OCCBase *> pending;
 };
 
 class OCCBase {
     public:
-        int transform(DVec mat, OCCBase *target);
-        int translate(OCCStruct3d delta, OCCBase *target);
-        int rotate(double angle, OCCStruct3d p1, OCCStruct3d p2, OCCBase *target);
+        OCCBase() : validState(VALID_UNKNOWN) { ; }
+        int transform(DVec mat, OCCBase *target, bool share);
+        int transform(const double *mat, OCCBase *target, bool share);
+        int translate(OCCStruct3d delta, OCCBase *target, bool share);
+        int rotate(double angle, OCCStruct3d p1, OCCStruct3d p2, OCCBase *target, bool share);
         int scale(OCCStruct3d pnt, double scale, OCCBase *target);
         int mirror(OCCStruct3d pnt, OCCStruct3d nor, OCCBase *target);
         DVec boundingBox(double tolerance);
@@ -120,11 +364,25 @@ class OCCBase {
         bool isNull();
         bool isValid();
         bool fixShape();
-        int toString(std::string *output);
+        bool fixShape(const OCCShapeSet& touched);
+        bool isKnownValid() { return validState == VALID_YES; }
+        int toString(std::string *output, bool binary, bool compress);
         int fromString(std::string input);
+        int toShared(const char *name, bool compress);
+        int fromShared(const char *name);
         virtual bool canSetShape(const TopoDS_Shape&) { return true; }
         virtual const TopoDS_Shape& getShape() { return TopoDS_Shape(); }
         virtual void setShape(TopoDS_Shape shape) { ; }
+        // In trusted mode fixShape skips checking, for pipelines
+        // which validate the result once at the end. The mode is
+        // kept per thread; fixShape runs on the calling thread.
+        static void setTrusted(bool trusted);
+        static bool isTrusted();
+    protected:
+        // Result of the last validity check, reset by setShape
+        enum {VALID_UNKNOWN, VALID_YES, VALID_NO};
+        int validState;
+        void moveShape(const gp_Trsf& trans, OCCBase *target, bool share);
 };
 
 class OCCVertex : public OCCBase { 
@@ -155,7 +413,10 @@ class OCCVertex : public OCCBase {
         std::string typeName() { return std::string("OCCVertex"); }
         const TopoDS_Shape& getShape() { return vertex; }
         const TopoDS_Vertex& getVertex() { return vertex; }
-        void setShape(TopoDS_Shape shape) { vertex = TopoDS::Vertex(shape); }
+        void setShape(TopoDS_Shape shape) {
+            vertex = TopoDS::Vertex(shape);
+            validState = VALID_UNKNOWN;
+        }
 };
 
 class OCCVertexIterator {
@@ -207,7 +468,10 @@ class OCCEdge : public OCCBase {
         }
         const TopoDS_Shape& getShape() { return edge; }
         const TopoDS_Edge& getEdge() { return edge; }
-        void setShape(TopoDS_Shape shape) { edge = TopoDS::Edge(shape); }
+        void setShape(TopoDS_Shape shape) {
+            edge = TopoDS::Edge(shape);
+            validState = VALID_UNKNOWN;
+        }
 };
 
 class OCCEdgeIterator {
@@ -251,7 +515,10 @@ class OCCWire : public OCCBase {
         }
         const TopoDS_Shape& getShape() { return wire; }
         const TopoDS_Wire& getWire() { return wire; }
-        void setShape(TopoDS_Shape shape) { wire = TopoDS::Wire(shape); }
+        void setShape(TopoDS_Shape shape) {
+            wire = TopoDS::Wire(shape);
+            validState = VALID_UNKNOWN;
+        }
 };
 
 class OCCWireIterator {
@@ -301,7 +568,10 @@ class OCCFace : public OCCBase {
         const TopoDS_Shape& getShape() { return face; }
         const TopoDS_Face& getFace() { return TopoDS::Face(face); }
         const TopoDS_Shell& getShell() { return TopoDS::Shell(face); }
-        void setShape(TopoDS_Shape shape) { face = shape; }
+        void setShape(TopoDS_Shape shape) {
+            face = shape;
+            validState = VALID_UNKNOWN;
+        }
 };
 
 class OCCFaceIterator {
@@ -328,7 +598,16 @@ class OCCFaceIterator {
 class OCCSolid : public OCCBase {
     public:
         TopoDS_Shape solid;
-        OCCSolid() { ; }
+        // Faces triangulated by the last createMesh and faces changed
+        // since then. hasHistory is cleared when the shape is set by
+        // operations which does not record their history.
+        OCCShapeSet meshedFaces;
+        OCCShapeSet modifiedFaces;
+        bool hasHistory;
+        double meshFactor;
+        double meshAngle;
+        double meshDeflection;
+        OCCSolid() : hasHistory(false), meshFactor(0.), meshAngle(0.), meshDeflection(0.) { ; }
         OCCSolid *copy(bool deepCopy);
         int numSolids();
         int numFaces();
@@ -337,7 +616,8 @@ class OCCSolid : public OCCBase {
         double volume();
         DVec inertia();
         OCCStruct3d centreOfMass();
-        OCCMesh *createMesh(double defle, double angle, bool qualityNormals);
+        OCCMesh *createMesh(double defle, double angle, bool qualityNormals,
+                            bool parallel);
         int addSolids(std::vector<OCCSolid *> solids);
         int createSphere(OCCStruct3d center, double radius);
         int createCylinder(OCCStruct3d p1, OCCStruct3d p2, double radius);
@@ -352,6 +632,8 @@ class OCCSolid : public OCCBase {
         int pipe(OCCFace *face, OCCWire *wire);
         int sweep(OCCWire *spine, std::vector<OCCBase *> profiles, int cornerMode);
         int boolean(OCCSolid *tool, BoolOpType op);
+        int booleanMany(std::vector<OCCSolid *> tools, BoolOpType op, bool slabs);
+        int fuseAll(std::vector<OCCSolid *> solids, bool sort);
         int fillet(std::vector<OCCEdge *> edges, std::vector<double> radius);
         int chamfer(std::vector<OCCEdge *> edges, std::vector<double> distances);
         int shell(std::vector<OCCFace *> faces, double offset, double tolerance);
@@ -364,6 +646,7 @@ class OCCSolid : public OCCBase {
         const TopoDS_Shape& getShape() { return solid; }
         const TopoDS_Shape& getSolid() { return solid; }
         void setShape(TopoDS_Shape shape);
+        void addHistory(const OCCShapeSet& modified);
 };
 
 class OCCSolidIterator {
@@ -386,4 +669,31 @@ class OCCSolidIterator {
             }
         }
 };
+
+// Assembly of prototype shapes placed by locations. Instances of
+// one prototype share the TShape, so the geometry is stored, written
+// and meshed once.
+class OCCAssembly {
+    public:
+        std::vector<TopoDS_Shape> prototypes;
+        std::vector<int> instances;
+        std::vector<TopLoc_Location> locations;
+        void clear();
+        int addShape(const TopoDS_Shape& shape);
+        int addShape(OCCBase *shape) { return addShape(shape->getShape()); }
+        int addInstance(int prototype, DVec mat);
+        TopoDS_Shape toShape();
+        int numPrototypes() { return prototypes.size(); }
+        int numInstances() { return instances.size(); }
+        OCCBase *getPrototype(int prototype);
+        int getInstance(int instance, double *mat);
+        OCCMesh *createMesh(int prototype, double factor, double angle, bool qualityNormals);
+        int readBREP(const char *filename);
+        int readSTEP(const char *filename);
+        int writeBREP(const char *filename);
+        int writeSTEP(const char *filename);
+    private:
+        typedef std::map<std::pair<const TopoDS_TShape *, int>, int> PrototypeMap;
+        void addLeaves(const TopoDS_Shape& shape, PrototypeMap& lookup);
+};
 #endif
@@ -5,8 +5,13 @@ cdef extern from "<string>" namespace "std":
     cdef cppclass string:
         string() nogil except +
         string(char *) nogil except +
+        string(char *, size_t) nogil except +
         char* c_str() nogil
+        size_t size() nogil
         
+cdef extern from "Standard.hxx":
+    void Standard_SetReentrant "Standard::SetReentrant"(bint isReentrant)
+    
 cdef extern from "<vector>" namespace "std":
     cdef cppclass vector[T]:
        vector()
@@ -15,8 +20,46 @@ cdef extern from "<vector>" namespace "std":
        size_t size()
        T& operator[](size_t)
 
-cdef extern from "OCCModel.h":
-    char errorMessage[256]
+cdef extern from "OCCModel.h" nogil:
+    cdef struct c_OCCErrorInfo "OCCErrorInfo":
+        char operation[64]
+        char type[64]
+        char message[256]
+    
+    char *getErrorMessage()
+    c_OCCErrorInfo *getErrorInfo()
+    
+    cdef enum c_NormalKernel "NormalKernel":
+        c_NORMALS_AUTO "NORMALS_AUTO"
+        c_NORMALS_SCALAR "NORMALS_SCALAR"
+        c_NORMALS_SSE "NORMALS_SSE"
+        c_NORMALS_AVX2 "NORMALS_AVX2"
+    
+    bint c_setNormalKernel "setNormalKernel"(c_NormalKernel kernel)
+    c_NormalKernel c_getNormalKernel "getNormalKernel"()
+    
+    cdef struct c_OCCShapeReport "OCCShapeReport":
+        int type
+        int index
+        bint checked
+        bint valid
+        bint fixed
+        double checkTime
+        double fixTime
+    
+    cdef enum c_ExportFormat "ExportFormat":
+        c_EXPORT_BREP "EXPORT_BREP"
+        c_EXPORT_BINARY "EXPORT_BINARY"
+        c_EXPORT_STEP "EXPORT_STEP"
+        c_EXPORT_STL "EXPORT_STL"
+        c_EXPORT_VRML "EXPORT_VRML"
+    
+    cdef struct c_OCCMeshCacheInfo "OCCMeshCacheInfo":
+        size_t budget
+        size_t size
+        size_t count
+        size_t hits
+        size_t misses
     
     cdef struct c_OCCStruct3d "OCCStruct3d":
         double x
@@ -70,15 +113,17 @@ cdef extern from "OCCModel.h":
         bint isEqual(c_OCCBase *other)
         bint isNull()
         bint isValid()
-        int transform(vector[double] mat, c_OCCBase *target)
-        int translate(c_OCCStruct3d delta, c_OCCBase *target)
-        int rotate(double angle, c_OCCStruct3d p1, c_OCCStruct3d p2, c_OCCBase *target)
+        int transform(vector[double] mat, c_OCCBase *target, bint share)
+        int translate(c_OCCStruct3d delta, c_OCCBase *target, bint share)
+        int rotate(double angle, c_OCCStruct3d p1, c_OCCStruct3d p2, c_OCCBase *target, bint share)
         int scale(c_OCCStruct3d pnt, double scale, c_OCCBase *target)
         int mirror(c_OCCStruct3d pnt, c_OCCStruct3d nor, c_OCCBase *target)
         vector[double] boundingBox(double tolerance)
         int findPlane(c_OCCStruct3d *origin, c_OCCStruct3d *normal, double tolerance)
-        int toString(string *output)
+        int toString(string *output, bint binary, bint compress)
         int fromString(string input)
+        int toShared(char *name, bint compress)
+        int fromShared(char *name)
         
     cdef cppclass c_OCCVertex "OCCVertex":
         c_OCCVertex(double x, double y, double z)
@@ -169,7 +214,8 @@ cdef extern from "OCCModel.h":
         double volume()
         vector[double] inertia()
         c_OCCStruct3d centreOfMass()
-        c_OCCMesh *createMesh(double factor, double angle, bint qualityNormals)
+        c_OCCMesh *createMesh(double factor, double angle, bint qualityNormals,
+                              bint parallel)
         int addSolids(vector[c_OCCSolid *] solids)
         int createSphere(c_OCCStruct3d center, double radius)
         int createCylinder(c_OCCStruct3d p1, c_OCCStruct3d p2, double radius)
@@ -184,6 +230,8 @@ cdef extern from "OCCModel.h":
         int sweep(c_OCCWire *spine, vector[c_OCCBase *] profiles, int cornerMode)
         int pipe(c_OCCFace *face, c_OCCWire *wire)
         int boolean(c_OCCSolid *tool, c_BoolOpType op)
+        int booleanMany(vector[c_OCCSolid *] tools, c_BoolOpType op, bint slabs)
+        int fuseAll(vector[c_OCCSolid *] solids, bint sort)
         int fillet(vector[c_OCCEdge *] edges, vector[double] radius)
         int chamfer(vector[c_OCCEdge *] edges, vector[double] distances)
         int shell(vector[c_OCCFace *] faces, double offset, double tolerance)
@@ -195,10 +243,55 @@ cdef extern from "OCCModel.h":
         void reset()
         c_OCCSolid *next()
 
-cdef extern from "OCCModel.h" namespace "OCCTools":
+    cdef cppclass c_OCCStepReader "OCCStepReader":
+        c_OCCStepReader()
+        int open(char *filename)
+        int numRoots()
+        bint more()
+        bint hasFailed()
+        c_OCCBase *next()
+
+    cdef cppclass c_OCCAssembly "OCCAssembly":
+        c_OCCAssembly()
+        void clear()
+        int addShape(c_OCCBase *shape)
+        int addInstance(int prototype, vector[double] mat)
+        int numPrototypes()
+        int numInstances()
+        c_OCCBase *getPrototype(int prototype)
+        int getInstance(int instance, double *mat)
+        c_OCCMesh *createMesh(int prototype, double factor, double angle, bint qualityNormals)
+        int readBREP(char *filename)
+        int readSTEP(char *filename)
+        int writeBREP(char *filename)
+        int writeSTEP(char *filename)
+    
+    cdef struct c_OCCExportJob "OCCExportJob":
+        c_OCCBase *shape
+        char *filename
+        c_ExportFormat format
+        int status
+        double time
+        char message[256]
+
+cdef extern from "OCCModel.h" namespace "OCCTools" nogil:
     int writeBREP(char *filename, vector[c_OCCBase *] shapes)
     int writeSTEP(char *filename, vector[c_OCCBase *] shapes)
     int writeSTL(char *filename, vector[c_OCCBase *] shapes)
     int writeVRML(char *filename, vector[c_OCCBase *] shapes)
-    int readBREP(char *filename, vector[c_OCCBase *] shapes)
-    int readSTEP(char *filename, vector[c_OCCBase *] shapes)
\ No newline at end of file
+    int exportMany(vector[c_OCCExportJob] jobs, int threads)
+    int transformMany(vector[c_OCCBase *] shapes, double *matrices, size_t n, int threads, bint share)
+    int writeMeshSTL(char *filename, vector[c_OCCMesh *] meshes)
+    int writeMeshGLB(char *filename, vector[c_OCCMesh *] meshes, bint quantize)
+    int readBREP(char *filename, vector[c_OCCBase *] shapes, vector[c_OCCShapeReport] *report)
+    int readSTEP(char *filename, vector[c_OCCBase *] shapes, vector[c_OCCShapeReport] *report, int threads)
+    int removeShared(char *name)
+
+cdef extern from "OCCModel.h" namespace "OCCMeshCache" nogil:
+    void meshCacheSetBudget "setBudget"(size_t bytes)
+    void meshCacheClear "clear"()
+    c_OCCMeshCacheInfo meshCacheInfo "info"()
+
+cdef extern from "OCCModel.h" namespace "OCCBase" nogil:
+    void baseSetTrusted "setTrusted"(bint trusted)
+    bint baseIsTrusted "isTrusted"()
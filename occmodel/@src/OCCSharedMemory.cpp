@@ -0,0 +1,362 @@
+// Copyright 2012 by Runar Tenfjord, Tenko as.
+// See LICENSE.txt for details on conditions.
+#include "OCCModel.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Shapes in named shared memory. The segment holds the size of the
+// binary shape data as 64 bit little endian followed by the data in
+// the format of OCCTools::writeBinary. Uncompressed data is written
+// straight into the mapped segment and the reader parses the data in
+// place, such that neither side copies it.
+
+static const size_t sizeFieldSize = 8;
+
+static void writeSize(char *dst, unsigned long long size)
+{
+    for (unsigned int i = 0; i < sizeFieldSize; i++)
+        dst[i] = (char)((size >> (8*i)) & 0xff);
+}
+
+static unsigned long long readSize(const char *src)
+{
+    unsigned long long size = 0;
+    for (unsigned int i = 0; i < sizeFieldSize; i++)
+        size |= (unsigned long long)(unsigned char)src[i] << (8*i);
+    return size;
+}
+
+#if defined(_WIN32)
+
+// The mapping only lives while a handle is open, so the handles of
+// written segments are kept until removed.
+static Standard_Mutex sharedMutex;
+static std::map<std::string, HANDLE> sharedHandles;
+
+struct SharedSegment {
+    const char *name;
+    HANDLE handle;
+    char *ptr;
+};
+
+// Create and map the segment for data of the given size
+static char *allocateShared(size_t dataSize, void *data)
+{
+    SharedSegment *seg = (SharedSegment *)data;
+    const unsigned long long size = sizeFieldSize + dataSize;
+    seg->handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                     (DWORD)(size >> 32), (DWORD)(size & 0xffffffff),
+                                     seg->name);
+    if (seg->handle == NULL) {
+        setError("OCCTools::writeShared", "", "Failed to create shared memory");
+        return NULL;
+    }
+
+    seg->ptr = (char *)MapViewOfFile(seg->handle, FILE_MAP_WRITE, 0, 0, (SIZE_T)size);
+    if (seg->ptr == NULL) {
+        setError("OCCTools::writeShared", "", "Failed to map shared memory");
+        return NULL;
+    }
+    writeSize(seg->ptr, dataSize);
+    return seg->ptr + sizeFieldSize;
+}
+
+int OCCTools::writeShared(const char *name, const TopoDS_Shape& shape, bool compress = false)
+{
+    SharedSegment seg;
+    seg.name = name;
+    seg.handle = NULL;
+    seg.ptr = NULL;
+
+    int ret = 1;
+    if (compress) {
+        std::string data;
+        char *ptr = NULL;
+        if (!OCCTools::writeBinary(data, shape, true) ||
+            (ptr = allocateShared(data.size(), &seg)) == NULL)
+            ret = 0;
+        else
+            memcpy(ptr, data.data(), data.size());
+    } else {
+        ret = OCCTools::writeBinary(shape, allocateShared, &seg);
+    }
+
+    if (seg.ptr != NULL)
+        UnmapViewOfFile(seg.ptr);
+    if (!ret) {
+        if (seg.handle != NULL)
+            CloseHandle(seg.handle);
+        return 0;
+    }
+    HANDLE handle = seg.handle;
+
+    Standard_Mutex::Sentry sentry(sharedMutex);
+    std::map<std::string, HANDLE>::iterator it = sharedHandles.find(name);
+    if (it != sharedHandles.end())
+        CloseHandle(it->second);
+    sharedHandles[name] = handle;
+    return 1;
+}
+
+int OCCTools::readShared(const char *name, TopoDS_Shape& shape)
+{
+    HANDLE handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (handle == NULL) {
+        setError("OCCTools::readShared", "", "Failed to open shared memory");
+        return 0;
+    }
+
+    const char *ptr = (const char *)MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(handle);
+    if (ptr == NULL) {
+        setError("OCCTools::readShared", "", "Failed to map shared memory");
+        return 0;
+    }
+
+    // the view size is rounded up to whole pages
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery(ptr, &info, sizeof(info));
+    const unsigned long long size = readSize(ptr);
+
+    int ret;
+    if (size > info.RegionSize - sizeFieldSize) {
+        setError("OCCTools::readShared", "", "Corrupt shared memory");
+        ret = 0;
+    } else {
+        ret = OCCTools::readBinary(ptr + sizeFieldSize, (size_t)size, shape);
+    }
+    UnmapViewOfFile(ptr);
+    return ret;
+}
+
+int OCCTools::removeShared(const char *name)
+{
+    Standard_Mutex::Sentry sentry(sharedMutex);
+    std::map<std::string, HANDLE>::iterator it = sharedHandles.find(name);
+    if (it == sharedHandles.end()) {
+        setError("OCCTools::removeShared", "", "Shared memory not found");
+        return 0;
+    }
+    CloseHandle(it->second);
+    sharedHandles.erase(it);
+    return 1;
+}
+
+bool OCCMappedFile::open(const char *filename, bool sequential = true)
+{
+    close();
+
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (sequential)
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, flags, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER filesize;
+    if (!GetFileSizeEx(file, &filesize) || filesize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return false;
+
+    const char *ptr = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (ptr == NULL) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    data = ptr;
+    size = (size_t)filesize.QuadPart;
+    handle = mapping;
+    return true;
+}
+
+void OCCMappedFile::close()
+{
+    if (data != NULL) {
+        UnmapViewOfFile(data);
+        CloseHandle((HANDLE)handle);
+    }
+    data = NULL;
+    size = 0;
+    handle = NULL;
+}
+
+#else
+
+// POSIX names start with a slash
+static std::string sharedName(const char *name)
+{
+    std::string ret(name);
+    if (ret.empty() || ret[0] != '/')
+        ret.insert(0, "/");
+    return ret;
+}
+
+struct SharedSegment {
+    std::string path;
+    bool created;
+    char *ptr;
+    size_t size;
+};
+
+// Create and map the segment for data of the given size
+static char *allocateShared(size_t dataSize, void *data)
+{
+    SharedSegment *seg = (SharedSegment *)data;
+    const size_t size = sizeFieldSize + dataSize;
+    int fd = shm_open(seg->path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd < 0) {
+        setError("OCCTools::writeShared", "", "Failed to create shared memory");
+        return NULL;
+    }
+    seg->created = true;
+
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        setError("OCCTools::writeShared", "", "Failed to size shared memory");
+        return NULL;
+    }
+
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        setError("OCCTools::writeShared", "", "Failed to map shared memory");
+        return NULL;
+    }
+    seg->ptr = (char *)ptr;
+    seg->size = size;
+    writeSize(seg->ptr, dataSize);
+    return seg->ptr + sizeFieldSize;
+}
+
+int OCCTools::writeShared(const char *name, const TopoDS_Shape& shape, bool compress = false)
+{
+    SharedSegment seg;
+    seg.path = sharedName(name);
+    seg.created = false;
+    seg.ptr = NULL;
+    seg.size = 0;
+
+    int ret = 1;
+    if (compress) {
+        std::string data;
+        char *ptr = NULL;
+        if (!OCCTools::writeBinary(data, shape, true) ||
+            (ptr = allocateShared(data.size(), &seg)) == NULL)
+            ret = 0;
+        else
+            memcpy(ptr, data.data(), data.size());
+    } else {
+        ret = OCCTools::writeBinary(shape, allocateShared, &seg);
+    }
+
+    if (seg.ptr != NULL)
+        munmap(seg.ptr, seg.size);
+    if (!ret && seg.created)
+        shm_unlink(seg.path.c_str());
+    return ret;
+}
+
+int OCCTools::readShared(const char *name, TopoDS_Shape& shape)
+{
+    const std::string path = sharedName(name);
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        setError("OCCTools::readShared", "", "Failed to open shared memory");
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeFieldSize) {
+        close(fd);
+        setError("OCCTools::readShared", "", "Corrupt shared memory");
+        return 0;
+    }
+    const size_t mapped = st.st_size;
+
+    void *ptr = mmap(NULL, mapped, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        setError("OCCTools::readShared", "", "Failed to map shared memory");
+        return 0;
+    }
+
+    const char *data = (const char *)ptr;
+    const unsigned long long size = readSize(data);
+
+    int ret;
+    if (size > mapped - sizeFieldSize) {
+        setError("OCCTools::readShared", "", "Corrupt shared memory");
+        ret = 0;
+    } else {
+        ret = OCCTools::readBinary(data + sizeFieldSize, (size_t)size, shape);
+    }
+    munmap(ptr, mapped);
+    return ret;
+}
+
+int OCCTools::removeShared(const char *name)
+{
+    const std::string path = sharedName(name);
+    if (shm_unlink(path.c_str()) != 0) {
+        setError("OCCTools::removeShared", "", "Shared memory not found");
+        return 0;
+    }
+    return 1;
+}
+
+bool OCCMappedFile::open(const char *filename, bool sequential = true)
+{
+    close();
+
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+
+    if (sequential) {
+        madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+        madvise(ptr, st.st_size, MADV_WILLNEED);
+    }
+
+    data = (const char *)ptr;
+    size = st.st_size;
+    return true;
+}
+
+void OCCMappedFile::close()
+{
+    if (data != NULL)
+        munmap((void *)data, size);
+    data = NULL;
+    size = 0;
+}
+
+#endif
@@ -61,13 +61,7 @@ int OCCSolid::createSolid(std::vector<OCCFace *> faces, double tolerance)
             StdFail_NotDone::Raise("solid not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create solid");
-        }
+        setFailure("OCCSolid::createSolid", "Failed to create solid");
         return 0;
     }
     return 1;
@@ -86,13 +80,7 @@ OCCSolid *OCCSolid::copy(bool deepCopy = false)
             ret->setShape(this->getShape());
         }
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to copy object");
-        }
+        setFailure("OCCSolid::copy", "Failed to copy object");
         return NULL;
     }
     return ret;
@@ -122,9 +110,34 @@ int OCCSolid::numFaces()
     return anIndices.Extent();
 }
 
-OCCMesh *OCCSolid::createMesh(double factor, double angle, bool qualityNormals = true)
+// Error state of workers is thread local, failures are
+// copied to the job for the calling thread.
+struct TriangulateJob {
+    const BRepMesh_FastDiscret *mesher;
+    const std::vector<TopoDS_Face> *faces;
+    std::vector<char> *failed;
+    std::vector<OCCErrorInfo> *errors;
+};
+
+static void triangulateFaceTask(void *data, int index) {
+    TriangulateJob *job = (TriangulateJob *)data;
+    try {
+        job->mesher->Process((*job->faces)[index]);
+    } catch(Standard_Failure &err) {
+        setFailure("OCCSolid::createMesh", "Failed to mesh face");
+        (*job->failed)[index] = 1;
+        (*job->errors)[index] = *getErrorInfo();
+    }
+}
+
+OCCMesh *OCCSolid::createMesh(double factor, double angle, bool qualityNormals = true,
+                              bool parallel = false)
 {
-    OCCMesh *mesh = new OCCMesh();
+    OCCMesh *mesh = OCCMeshCache::find(this->getShape(), factor, angle, qualityNormals);
+    if (mesh != NULL)
+        return mesh;
+    
+    mesh = new OCCMesh();
     const TopoDS_Shape& shape = this->getShape();
     
     try {
@@ -139,11 +152,7 @@ OCCMesh *OCCSolid::createMesh(double factor, double angle, bool qualityNormals =
         maxd = std::max(maxd, fabs(aYmax - aYmin));
         maxd = std::max(maxd, fabs(aZmax - aZmin));
         
-        BRepMesh_FastDiscret MSH(factor*maxd, angle, aBox, Standard_True, Standard_True, 
-                                 Standard_True, Standard_True);
-        
-        MSH.Perform(shape);
-        
+        std::vector<TopoDS_Face> faces;
         if (shape.ShapeType() == TopAbs_COMPSOLID || shape.ShapeType() == TopAbs_COMPOUND) {
             TopExp_Explorer exSolid, exFace;
             for (exSolid.Init(shape, TopAbs_SOLID); exSolid.More(); exSolid.Next()) {
@@ -151,7 +160,7 @@ OCCMesh *OCCSolid::createMesh(double factor, double angle, bool qualityNormals =
                 for (exFace.Init(solid, TopAbs_FACE); exFace.More(); exFace.Next()) {
                     const TopoDS_Face& face = static_cast<const TopoDS_Face &>(exFace.Current());
                     if (face.IsNull()) continue;
-                    mesh->extractFaceMesh(face, qualityNormals);
+                    faces.push_back(face);
                 }
             }
         }  else {
@@ -159,19 +168,89 @@ OCCMesh *OCCSolid::createMesh(double factor, double angle, bool qualityNormals =
             for (exFace.Init(shape, TopAbs_FACE); exFace.More(); exFace.Next()) {
                 const TopoDS_Face& face = static_cast<const TopoDS_Face &>(exFace.Current());
                 if (face.IsNull()) continue;
-                mesh->extractFaceMesh(face, qualityNormals);
+                faces.push_back(face);
             }
         }
-    } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
+        
+        // Faces not changed since the last mesh keep their triangulation
+        // and are only extracted. The previous deflection is used such
+        // that shared edges are discretized alike on both sides.
+        Standard_Real deflection = factor*maxd;
+        const bool incremental = this->hasHistory && this->meshDeflection > 0. &&
+                                 factor == this->meshFactor && angle == this->meshAngle;
+        if (incremental)
+            deflection = this->meshDeflection;
+        
+        std::vector<TopoDS_Face> changed;
+        for (unsigned int i = 0; i < faces.size(); i++) {
+            const TopoDS_Face& face = faces[i];
+            if (incremental && this->meshedFaces.contains(face) &&
+                !this->modifiedFaces.contains(face)) {
+                TopLoc_Location loc;
+                if (!BRep_Tool::Triangulation(face, loc).IsNull())
+                    continue;
+            }
+            changed.push_back(face);
+        }
+        
+        BRepMesh_FastDiscret MSH(deflection, angle, aBox, Standard_True, Standard_True, 
+                                 Standard_True, Standard_True);
+        
+        if (!parallel && !incremental) {
+            MSH.Perform(shape);
         } else {
-            setErrorMessage("Failed to mesh object");
+            // discretize edges sequentially and triangulate
+            // the faces, possible in parallel.
+            for (unsigned int i = 0; i < changed.size(); i++)
+                MSH.Add(changed[i]);
+            
+            std::vector<char> failed(changed.size(), 0);
+            std::vector<OCCErrorInfo> errors(changed.size());
+            TriangulateJob job;
+            job.mesher = &MSH;
+            job.faces = &changed;
+            job.failed = &failed;
+            job.errors = &errors;
+            if (parallel) {
+                parallelFor(changed.size(), triangulateFaceTask, &job);
+            } else {
+                for (unsigned int i = 0; i < changed.size(); i++)
+                    triangulateFaceTask(&job, i);
+            }
+            
+            // a face left without triangulation would be a hole
+            for (unsigned int i = 0; i < changed.size(); i++) {
+                if (failed[i]) {
+                    this->hasHistory = false;
+                    delete mesh;
+                    setError(errors[i]);
+                    return NULL;
+                }
+            }
+        }
+        
+        if (!mesh->extractFaces(faces, qualityNormals, parallel) && !faces.empty()) {
+            this->hasHistory = false;
+            delete mesh;
+            return NULL;
         }
+        
+        this->meshedFaces.clear();
+        for (unsigned int i = 0; i < faces.size(); i++)
+            this->meshedFaces.add(faces[i]);
+        this->modifiedFaces.clear();
+        this->hasHistory = true;
+        this->meshFactor = factor;
+        this->meshAngle = angle;
+        this->meshDeflection = deflection;
+        
+    } catch(Standard_Failure &err) {
+        this->hasHistory = false;
+        delete mesh;
+        setFailure("OCCSolid::createMesh", "Failed to mesh object");
         return NULL;
     }
+    OCCMeshCache::insert(this->getShape(), factor, angle, qualityNormals, mesh);
     return mesh;
 }
 
@@ -205,13 +284,7 @@ int OCCSolid::addSolids(std::vector<OCCSolid *> solids)
         }
         this->setShape(C);
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to add solid");
-        }
+        setFailure("OCCSolid::addSolids", "Failed to add solid");
         return 0;
     }
     return 1;
@@ -228,13 +301,7 @@ int OCCSolid::createSphere(OCCStruct3d center, double radius)
         
         this->setShape(BRepPrimAPI_MakeSphere(aP, radius).Shape());
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create sphere");
-        }
+        setFailure("OCCSolid::createSphere", "Failed to create sphere");
         return 0;
     }
     return 1;
@@ -259,13 +326,7 @@ int OCCSolid::createCylinder(OCCStruct3d p1, OCCStruct3d p2, double radius)
         MC.Build();
         this->setShape(MC.Shape());
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create cylinder");
-        }
+        setFailure("OCCSolid::createCylinder", "Failed to create cylinder");
         return 0;
     }
     return 1;
@@ -293,13 +354,7 @@ int OCCSolid::createTorus(OCCStruct3d p1, OCCStruct3d p2, double ringRadius, dou
         MC.Build();
         this->setShape(MC.Shape());
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create torus");
-        }
+        setFailure("OCCSolid::createTorus", "Failed to create torus");
         return 0;
     }
     return 1;
@@ -318,13 +373,7 @@ int OCCSolid::createCone(OCCStruct3d p1, OCCStruct3d p2, double radius1, double
         MC.Build();
         this->setShape(MC.Shape());
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create cone");
-        }
+        setFailure("OCCSolid::createCone", "Failed to create cone");
         return 0;
     }
     return 1;
@@ -338,13 +387,7 @@ int OCCSolid::createBox(OCCStruct3d p1, OCCStruct3d p2) {
         MB.Build();
         this->setShape(MB.Shape());
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create box");
-        }
+        setFailure("OCCSolid::createBox", "Failed to create box");
         return 0;
     }
     return 1;
@@ -571,13 +614,7 @@ int OCCSolid::createText(double height, double depth, const char *text, const ch
         if (fontpath && data) free(data);
         if (fp) fclose(fp);
         
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create solids from font data");
-        }
+        setFailure("OCCSolid::createText", "Failed to create solids from font data");
         return 0;
     }
     return 1;
@@ -593,13 +630,7 @@ int OCCSolid::createPrism(OCCFace *face, OCCStruct3d normal, bool isInfinite) {
         BRepPrimAPI_MakePrism MP(face->getShape(), direction, inf);
         this->setShape(MP.Shape());
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create prism");
-        }
+        setFailure("OCCSolid::createPrism", "Failed to create prism");
         return 0;
     }
     return 1;
@@ -659,13 +690,7 @@ int OCCSolid::extrude(OCCFace *face, OCCStruct3d p1, OCCStruct3d p2)
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to extrude");
-        }
+        setFailure("OCCSolid::extrude", "Failed to extrude");
         return 0;
     }
     return 1;
@@ -684,13 +709,7 @@ int OCCSolid::revolve(OCCFace *face, OCCStruct3d p1, OCCStruct3d p2, double angl
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to revolve");
-        }
+        setFailure("OCCSolid::revolve", "Failed to revolve");
         return 0;
     }
     return 1;
@@ -707,13 +726,7 @@ int OCCSolid::pipe(OCCFace *face, OCCWire *wire)
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create pipe");
-        }
+        setFailure("OCCSolid::pipe", "Failed to create pipe");
         return 0;
     }
     return 1;
@@ -750,13 +763,7 @@ int OCCSolid::sweep(OCCWire *spine, std::vector<OCCBase *> profiles, int cornerM
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create sweep");
-        }
+        setFailure("OCCSolid::sweep", "Failed to create sweep");
         return 0;
     }
     return 1;
@@ -788,20 +795,39 @@ int OCCSolid::loft(std::vector<OCCBase *> profiles, bool ruled, double tolerance
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to loft");
-        }
+        setFailure("OCCSolid::loft", "Failed to loft");
         return 0;
     }
     return 1;
 }
 
+// Collect faces of the result modified or generated from faces of input.
+// With keepAll set, faces of input passed unchanged are included.
+template <class Builder>
+static void collectModified(Builder& op, const TopoDS_Shape& input,
+                            OCCShapeSet& modified, bool keepAll = false)
+{
+    TopExp_Explorer ex;
+    TopTools_ListIteratorOfListOfShape it;
+    for (ex.Init(input, TopAbs_FACE); ex.More(); ex.Next()) {
+        const TopoDS_Shape& face = ex.Current();
+        if (op.IsDeleted(face))
+            continue;
+        const TopTools_ListOfShape& images = op.Modified(face);
+        if (keepAll && images.IsEmpty())
+            modified.add(face);
+        for (it.Initialize(images); it.More(); it.Next())
+            modified.add(it.Value());
+        for (it.Initialize(op.Generated(face)); it.More(); it.Next())
+            modified.add(it.Value());
+    }
+}
+
 int OCCSolid::boolean(OCCSolid *tool, BoolOpType op) {
     try {
+        const bool tracked = this->hasHistory;
+        const bool wasValid = this->isKnownValid() && tool->isKnownValid();
+        OCCShapeSet modified;
         TopoDS_Shape shape;
         switch (op) {
             case BOOL_FUSE:
@@ -810,6 +836,8 @@ int OCCSolid::boolean(OCCSolid *tool, BoolOpType op) {
                 if (!FU.IsDone())
                     Standard_ConstructionError::Raise("operation failed");
                 shape = FU.Shape();
+                collectModified(FU, this->getShape(), modified);
+                collectModified(FU, tool->getShape(), modified);
                 break;
             }
             case BOOL_CUT:
@@ -818,6 +846,8 @@ int OCCSolid::boolean(OCCSolid *tool, BoolOpType op) {
                 if (!CU.IsDone())
                     Standard_ConstructionError::Raise("operation failed");
                 shape = CU.Shape();
+                collectModified(CU, this->getShape(), modified);
+                collectModified(CU, tool->getShape(), modified);
                 break;
             }
             case BOOL_COMMON:
@@ -826,6 +856,8 @@ int OCCSolid::boolean(OCCSolid *tool, BoolOpType op) {
                 if (!CO.IsDone())
                     Standard_ConstructionError::Raise("operation failed");
                 shape = CO.Shape();
+                collectModified(CO, this->getShape(), modified);
+                collectModified(CO, tool->getShape(), modified);
                 break;
             }
             default:
@@ -843,19 +875,604 @@ int OCCSolid::boolean(OCCSolid *tool, BoolOpType op) {
         }
         
         this->setShape(shape);
+        if (tracked)
+            this->addHistory(modified);
         
         // possible fix shape
-        if (!this->fixShape())
+        if (!(wasValid ? this->fixShape(modified) : this->fixShape()))
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed in boolean operation");
+        setFailure("OCCSolid::boolean", "Failed in boolean operation");
+        return 0;
+    }
+    return 1;
+}
+
+#if OCC_VERSION_HEX >= 0x060600
+static int findRoot(std::vector<int>& parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Group tools with overlapping bounding boxes. Tools outside of box
+// are left out, unless box is void.
+static void clusterTools(const std::vector<TopoDS_Shape>& tools, const Bnd_Box& box,
+                         std::vector<std::vector<TopoDS_Shape> >& clusters,
+                         std::vector<Bnd_Box>& clusterBoxes)
+{
+    const int ntools = tools.size();
+    std::vector<Bnd_Box> boxes(ntools);
+    for (int i = 0; i < ntools; i++) {
+        BRepBndLib::Add(tools[i], boxes[i]);
+        if (!box.IsVoid() && boxes[i].IsOut(box))
+            boxes[i].SetVoid();
+    }
+    
+    OCCBoxTree tree(boxes);
+    std::vector<int> parent(ntools);
+    for (int i = 0; i < ntools; i++)
+        parent[i] = i;
+    
+    std::vector<int> found;
+    for (int i = 0; i < ntools; i++) {
+        found.clear();
+        tree.overlapping(boxes[i], found);
+        for (unsigned int j = 0; j < found.size(); j++) {
+            const int a = findRoot(parent, i);
+            const int b = findRoot(parent, found[j]);
+            if (a != b)
+                parent[std::max(a, b)] = std::min(a, b);
+        }
+    }
+    
+    // clusters ordered by their first tool
+    std::vector<int> cluster(ntools, -1);
+    for (int i = 0; i < ntools; i++) {
+        if (boxes[i].IsVoid())
+            continue;
+        const int root = findRoot(parent, i);
+        if (cluster[root] < 0) {
+            cluster[root] = clusters.size();
+            clusters.push_back(std::vector<TopoDS_Shape>());
+            clusterBoxes.push_back(Bnd_Box());
+        }
+        clusters[cluster[root]].push_back(tools[i]);
+        clusterBoxes[cluster[root]].Add(boxes[i]);
+    }
+}
+
+struct FuseClusterJob {
+    const std::vector<std::vector<TopoDS_Shape> > *clusters;
+    std::vector<TopoDS_Shape> *fused;
+};
+
+static void fuseClusterTask(void *data, int index) {
+    FuseClusterJob *job = (FuseClusterJob *)data;
+    const std::vector<TopoDS_Shape>& cluster = (*job->clusters)[index];
+    if (cluster.size() == 1) {
+        (*job->fused)[index] = cluster[0];
+        return;
+    }
+    
+    // Left Null on failure, the tools are then used one by one. The
+    // tools are copied like in cutSlabTask, as tools moved by location
+    // share sub shapes and the boolean changes their tolerances.
+    try {
+        BOPAlgo_BOP BOP;
+        for (unsigned int i = 0; i < cluster.size(); i++) {
+            BRepBuilderAPI_Copy toolCopy(cluster[i]);
+            if (i == 0)
+                BOP.AddArgument(toolCopy.Shape());
+            else
+                BOP.AddTool(toolCopy.Shape());
+        }
+        BOP.SetOperation(BOPAlgo_FUSE);
+        BOP.Perform();
+        if (!BOP.ErrorStatus())
+            (*job->fused)[index] = BOP.Shape();
+    } catch(Standard_Failure &err) {
+        return;
+    }
+}
+
+// Split the range of the solid along its longest axis at gaps between
+// the clusters, such that each cluster falls in one slab. Each slab
+// gets about the same number of clusters. Returns the axis and the
+// slab of each cluster.
+static int slabClusters(const Bnd_Box& box, const std::vector<Bnd_Box>& clusterBoxes,
+                        int nslabs, std::vector<double>& borders,
+                        std::vector<int>& slab)
+{
+    Standard_Real xmin, ymin, zmin, xmax, ymax, zmax;
+    box.Get(xmin, ymin, zmin, xmax, ymax, zmax);
+    const double extent[3] = {xmax - xmin, ymax - ymin, zmax - zmin};
+    int axis = 0;
+    if (extent[1] > extent[axis]) axis = 1;
+    if (extent[2] > extent[axis]) axis = 2;
+    
+    const int nclusters = clusterBoxes.size();
+    std::vector<std::pair<double, int> > order(nclusters);
+    std::vector<double> lo(nclusters), hi(nclusters);
+    for (int i = 0; i < nclusters; i++) {
+        double cmin[3], cmax[3];
+        clusterBoxes[i].Get(cmin[0], cmin[1], cmin[2], cmax[0], cmax[1], cmax[2]);
+        lo[i] = cmin[axis];
+        hi[i] = cmax[axis];
+        order[i] = std::make_pair(lo[i], i);
+    }
+    std::sort(order.begin(), order.end());
+    
+    borders.clear();
+    slab.assign(nclusters, 0);
+    const int target = std::max(1, nclusters/nslabs);
+    int count = 0;
+    double reach = -std::numeric_limits<double>::max();
+    for (int k = 0; k < nclusters; k++) {
+        const int i = order[k].second;
+        // a border at a gap in front of cluster i
+        if (count >= target && lo[i] > reach &&
+            (int)borders.size() < nslabs - 1) {
+            borders.push_back(.5*(reach + lo[i]));
+            count = 0;
+        }
+        slab[i] = borders.size();
+        reach = std::max(reach, hi[i]);
+        count++;
+    }
+    return axis;
+}
+
+// Job for the parallel cut of slabs. Each slab works on its own
+// copy of the solid and the tools, as the boolean operations may
+// change tolerances of the arguments in place and tools may share
+// sub shapes after rigid moves.
+struct CutSlabJob {
+    TopoDS_Shape solid;
+    const std::vector<std::vector<TopoDS_Shape> > *clusters;
+    const std::vector<int> *slab;
+    std::vector<gp_Pnt> lower, upper;
+    std::vector<TopoDS_Shape> *pieces;
+    std::vector<char> *failed;
+    std::vector<OCCErrorInfo> *errors;
+};
+
+static void cutSlabTask(void *data, int index) {
+    CutSlabJob *job = (CutSlabJob *)data;
+    try {
+        BRepBuilderAPI_Copy solidCopy(job->solid);
+        BRepPrimAPI_MakeBox slabBox(job->lower[index], job->upper[index]);
+        BRepAlgoAPI_Common CO(solidCopy.Shape(), slabBox.Shape());
+        if (!CO.IsDone())
+            Standard_ConstructionError::Raise("operation failed");
+        
+        BOPAlgo_BOP BOP;
+        BOP.AddArgument(CO.Shape());
+        int ntools = 0;
+        for (unsigned int i = 0; i < job->clusters->size(); i++) {
+            if ((*job->slab)[i] != index)
+                continue;
+            const std::vector<TopoDS_Shape>& cluster = (*job->clusters)[i];
+            for (unsigned int j = 0; j < cluster.size(); j++) {
+                BRepBuilderAPI_Copy toolCopy(cluster[j]);
+                BOP.AddTool(toolCopy.Shape());
+                ntools++;
+            }
         }
+        
+        if (ntools == 0) {
+            (*job->pieces)[index] = CO.Shape();
+            return;
+        }
+        
+        BOP.SetOperation(BOPAlgo_CUT);
+        BOP.Perform();
+        if (BOP.ErrorStatus())
+            Standard_ConstructionError::Raise("operation failed");
+        (*job->pieces)[index] = BOP.Shape();
+    } catch(Standard_Failure &err) {
+        setFailure("OCCSolid::booleanMany", "Failed in boolean operation");
+        (*job->failed)[index] = 1;
+        (*job->errors)[index] = *getErrorInfo();
+    }
+}
+
+// With few clusters the split and join of the slabs costs more
+// than the single pass.
+static const unsigned int minSlabClusters = 16;
+
+// Cut the slabs in parallel and fuse the pieces again. The faces
+// split at the slab borders are merged afterwards. Returns a Null
+// shape if the clusters could not be split in slabs.
+static TopoDS_Shape cutSlabs(const TopoDS_Shape& solid, const Bnd_Box& box,
+                             const std::vector<std::vector<TopoDS_Shape> >& clusters,
+                             const std::vector<Bnd_Box>& clusterBoxes)
+{
+    TopoDS_Shape ret;
+    const int threads = numThreads();
+    if (threads < 2 || clusters.size() < minSlabClusters)
+        return ret;
+    
+    std::vector<double> borders;
+    std::vector<int> slab;
+    const int axis = slabClusters(box, clusterBoxes, threads, borders, slab);
+    if (borders.empty())
+        return ret;
+    
+    // slab boxes reach out of the solid box, except at the borders
+    Standard_Real xmin, ymin, zmin, xmax, ymax, zmax;
+    box.Get(xmin, ymin, zmin, xmax, ymax, zmax);
+    const double margin = 1. + std::max(xmax - xmin, std::max(ymax - ymin, zmax - zmin));
+    gp_XYZ lower(xmin - margin, ymin - margin, zmin - margin);
+    gp_XYZ upper(xmax + margin, ymax + margin, zmax + margin);
+    
+    const int nslabs = borders.size() + 1;
+    CutSlabJob job;
+    job.solid = solid;
+    job.clusters = &clusters;
+    job.slab = &slab;
+    for (int i = 0; i < nslabs; i++) {
+        gp_XYZ a(lower), b(upper);
+        if (i > 0)
+            a.SetCoord(axis + 1, borders[i - 1]);
+        if (i < nslabs - 1)
+            b.SetCoord(axis + 1, borders[i]);
+        job.lower.push_back(gp_Pnt(a));
+        job.upper.push_back(gp_Pnt(b));
+    }
+    
+    std::vector<TopoDS_Shape> pieces(nslabs);
+    std::vector<char> failed(nslabs, 0);
+    std::vector<OCCErrorInfo> errors(nslabs);
+    job.pieces = &pieces;
+    job.failed = &failed;
+    job.errors = &errors;
+    parallelFor(nslabs, cutSlabTask, &job, threads);
+    
+    for (int i = 0; i < nslabs; i++) {
+        if (failed[i])
+            Standard_ConstructionError::Raise(errors[i].message);
+    }
+    
+    // slabs without material are left out
+    BOPAlgo_BOP BOP;
+    int npieces = 0;
+    for (int i = 0; i < nslabs; i++) {
+        TopExp_Explorer ex(pieces[i], TopAbs_SOLID);
+        if (!ex.More())
+            continue;
+        if (npieces++ == 0)
+            BOP.AddArgument(pieces[i]);
+        else
+            BOP.AddTool(pieces[i]);
+    }
+    
+    if (npieces == 0)
+        Standard_ConstructionError::Raise("result object is empty compound");
+    if (npieces == 1) {
+        for (int i = 0; i < nslabs; i++) {
+            TopExp_Explorer ex(pieces[i], TopAbs_SOLID);
+            if (ex.More())
+                ret = pieces[i];
+        }
+        return ret;
+    }
+    
+    BOP.SetOperation(BOPAlgo_FUSE);
+#if OCC_VERSION_HEX >= 0x060800
+    BOP.SetRunParallel(Standard_True);
+#endif
+    BOP.Perform();
+    if (BOP.ErrorStatus())
+        Standard_ConstructionError::Raise("operation failed");
+    
+    ShapeUpgrade_UnifySameDomain unify(BOP.Shape(), Standard_True, Standard_True,
+                                       Standard_False);
+    unify.Build();
+    ret = unify.Shape();
+    return ret;
+}
+#endif
+
+int OCCSolid::booleanMany(std::vector<OCCSolid *> tools, BoolOpType op,
+                          bool slabs = false) {
+#if OCC_VERSION_HEX >= 0x060600
+    try {
+        if (tools.empty())
+            StdFail_NotDone::Raise("no tools given");
+        
+        const bool tracked = this->hasHistory;
+        bool wasValid = this->isKnownValid();
+        for (unsigned int i = 0; i < tools.size(); i++)
+            wasValid = wasValid && tools[i]->isKnownValid();
+        OCCShapeSet modified;
+        
+        // compound tools, e.g. from addSolids, are split in their solids
+        std::vector<TopoDS_Shape> shapes;
+        for (unsigned int i = 0; i < tools.size(); i++) {
+            const TopoDS_Shape& tool = tools[i]->getShape();
+            if (tool.ShapeType() == TopAbs_COMPOUND) {
+                TopExp_Explorer ex;
+                for (ex.Init(tool, TopAbs_SOLID); ex.More(); ex.Next())
+                    shapes.push_back(ex.Current());
+            } else {
+                shapes.push_back(tool);
+            }
+        }
+        
+        // tools outside of the solid have no effect on cut and common
+        Bnd_Box box;
+        if (op != BOOL_FUSE)
+            BRepBndLib::Add(this->getShape(), box);
+        
+        std::vector<std::vector<TopoDS_Shape> > clusters;
+        std::vector<Bnd_Box> clusterBoxes;
+        clusterTools(shapes, box, clusters, clusterBoxes);
+        if (clusters.empty()) {
+            if (op == BOOL_CUT)
+                return 1;
+            Standard_ConstructionError::Raise("result object is empty compound");
+        }
+        
+        // Optionally independent clusters are cut from separate slabs
+        // of the solid in parallel. Merging the faces split at the slab
+        // borders also merges other faces on the same surface, so the
+        // topology can differ from the single pass. The history of
+        // modified faces is not kept, the next mesh is made from scratch.
+        if (op == BOOL_CUT && slabs) {
+            const TopoDS_Shape shape = cutSlabs(this->getShape(), box, clusters,
+                                                clusterBoxes);
+            if (!shape.IsNull()) {
+                this->setShape(shape);
+                if (!this->fixShape())
+                    StdFail_NotDone::Raise("Shapes not valid");
+                return 1;
+            }
+        }
+        
+        // overlapping tools are fused first, cluster by cluster in
+        // parallel, which leaves fewer and disjoint tools.
+        std::vector<TopoDS_Shape> fused(clusters.size());
+        FuseClusterJob job;
+        job.clusters = &clusters;
+        job.fused = &fused;
+        parallelFor(clusters.size(), fuseClusterTask, &job);
+        
+        // all tools are intersected in one pass of the general
+        // fuse algorithm.
+        BOPAlgo_BOP BOP;
+        BOP.AddArgument(this->getShape());
+        for (unsigned int i = 0; i < clusters.size(); i++) {
+            if (!fused[i].IsNull()) {
+                BOP.AddTool(fused[i]);
+            } else {
+                for (unsigned int j = 0; j < clusters[i].size(); j++)
+                    BOP.AddTool(clusters[i][j]);
+            }
+        }
+        
+        switch (op) {
+            case BOOL_FUSE:
+                BOP.SetOperation(BOPAlgo_FUSE);
+                break;
+            case BOOL_CUT:
+                BOP.SetOperation(BOPAlgo_CUT);
+                break;
+            case BOOL_COMMON:
+                BOP.SetOperation(BOPAlgo_COMMON);
+                break;
+            default:
+                Standard_ConstructionError::Raise("unknown operation");
+                break;
+        }
+#if OCC_VERSION_HEX >= 0x060800
+        BOP.SetRunParallel(Standard_True);
+#endif
+        BOP.Perform();
+        if (BOP.ErrorStatus())
+            Standard_ConstructionError::Raise("operation failed");
+        
+        const TopoDS_Shape& shape = BOP.Shape();
+        
+        // check for empty compund shape
+        TopoDS_Iterator It (shape, Standard_True, Standard_True);
+        int found = 0;
+        for (; It.More(); It.Next())
+            found++;
+        if (found == 0) {
+            Standard_ConstructionError::Raise("result object is empty compound");
+        }
+        
+        // faces of fused clusters are new and always included
+        collectModified(BOP, this->getShape(), modified);
+        for (unsigned int i = 0; i < clusters.size(); i++) {
+            if (!fused[i].IsNull() && clusters[i].size() > 1) {
+                collectModified(BOP, fused[i], modified, true);
+            } else {
+                for (unsigned int j = 0; j < clusters[i].size(); j++)
+                    collectModified(BOP, clusters[i][j], modified);
+            }
+        }
+        
+        this->setShape(shape);
+        if (tracked)
+            this->addHistory(modified);
+        
+        // possible fix shape
+        if (!(wasValid ? this->fixShape(modified) : this->fixShape()))
+            StdFail_NotDone::Raise("Shapes not valid");
+        
+    } catch(Standard_Failure &err) {
+        setFailure("OCCSolid::booleanMany", "Failed in boolean operation");
+        return 0;
+    }
+    return 1;
+#else
+    // general fuse not available, use tools as one compound
+    OCCSolid tool;
+    if (!tool.addSolids(tools))
+        return 0;
+    return this->boolean(&tool, op);
+#endif
+}
+
+// Interleave the lower 10 bits of x, y and z
+static unsigned int mortonCode(unsigned int x, unsigned int y, unsigned int z)
+{
+    unsigned int code = 0;
+    for (int i = 0; i < 10; i++) {
+        code |= ((x >> i) & 1u) << (3*i);
+        code |= ((y >> i) & 1u) << (3*i + 1);
+        code |= ((z >> i) & 1u) << (3*i + 2);
+    }
+    return code;
+}
+
+struct MortonLess {
+    const std::vector<unsigned int> *codes;
+    bool operator()(int a, int b) const {
+        return (*codes)[a] < (*codes)[b];
+    }
+};
+
+// Order shapes along a Morton curve through their box centres, such
+// that neighbours are fused first.
+static void spatialSort(std::vector<TopoDS_Shape>& shapes)
+{
+    const int n = shapes.size();
+    std::vector<double> centres(3*n);
+    Bnd_Box all;
+    for (int i = 0; i < n; i++) {
+        Bnd_Box box;
+        BRepBndLib::Add(shapes[i], box);
+        if (box.IsVoid())
+            continue;
+        Standard_Real xmin, ymin, zmin, xmax, ymax, zmax;
+        box.Get(xmin, ymin, zmin, xmax, ymax, zmax);
+        centres[3*i] = .5*(xmin + xmax);
+        centres[3*i + 1] = .5*(ymin + ymax);
+        centres[3*i + 2] = .5*(zmin + zmax);
+        all.Add(gp_Pnt(centres[3*i], centres[3*i + 1], centres[3*i + 2]));
+    }
+    if (all.IsVoid())
+        return;
+    
+    Standard_Real min[3], max[3];
+    all.Get(min[0], min[1], min[2], max[0], max[1], max[2]);
+    
+    std::vector<unsigned int> codes(n);
+    for (int i = 0; i < n; i++) {
+        unsigned int q[3];
+        for (int j = 0; j < 3; j++) {
+            const double size = max[j] - min[j];
+            const double t = size > 0. ? (centres[3*i + j] - min[j])/size : 0.;
+            q[j] = (unsigned int)(std::min(std::max(t, 0.), 1.)*1023.);
+        }
+        codes[i] = mortonCode(q[0], q[1], q[2]);
+    }
+    
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++)
+        order[i] = i;
+    MortonLess less;
+    less.codes = &codes;
+    std::stable_sort(order.begin(), order.end(), less);
+    
+    std::vector<TopoDS_Shape> sorted(n);
+    for (int i = 0; i < n; i++)
+        sorted[i] = shapes[order[i]];
+    shapes.swap(sorted);
+}
+
+// Job for one level of the pairwise fuse. The input solids may share
+// sub shapes, e.g. after copy() or moves with share, and the boolean
+// operations change tolerances of the arguments in place, so the
+// first level works on copies of them.
+struct FusePairsJob {
+    const std::vector<TopoDS_Shape> *shapes;
+    bool copy;
+    std::vector<TopoDS_Shape> *fused;
+    std::vector<char> *failed;
+    std::vector<OCCErrorInfo> *errors;
+};
+
+static void fusePairTask(void *data, int index) {
+    FusePairsJob *job = (FusePairsJob *)data;
+    try {
+        TopoDS_Shape a = (*job->shapes)[2*index];
+        TopoDS_Shape b = (*job->shapes)[2*index + 1];
+        if (job->copy) {
+            BRepBuilderAPI_Copy copyA(a), copyB(b);
+            a = copyA.Shape();
+            b = copyB.Shape();
+        }
+        BRepAlgoAPI_Fuse FU(a, b);
+        if (!FU.IsDone())
+            Standard_ConstructionError::Raise("operation failed");
+        (*job->fused)[index] = FU.Shape();
+    } catch(Standard_Failure &err) {
+        setFailure("OCCSolid::fuseAll", "Failed in boolean operation");
+        (*job->failed)[index] = 1;
+        (*job->errors)[index] = *getErrorInfo();
+    }
+}
+
+int OCCSolid::fuseAll(std::vector<OCCSolid *> solids, bool sort = true) {
+    try {
+        std::vector<TopoDS_Shape> shapes;
+        if (!this->getShape().IsNull())
+            shapes.push_back(this->getShape());
+        for (unsigned int i = 0; i < solids.size(); i++)
+            shapes.push_back(solids[i]->getShape());
+        
+        if (shapes.empty())
+            StdFail_NotDone::Raise("no solids given");
+        
+        if (sort)
+            spatialSort(shapes);
+        
+        // Balanced pairwise reduction. The pairs of each level are
+        // independent and fused in parallel.
+        bool first = true;
+        while (shapes.size() > 1) {
+            const int npairs = shapes.size()/2;
+            std::vector<TopoDS_Shape> fused((shapes.size() + 1)/2);
+            std::vector<char> failed(npairs, 0);
+            std::vector<OCCErrorInfo> errors(npairs);
+            
+            FusePairsJob job;
+            job.shapes = &shapes;
+            job.copy = first;
+            job.fused = &fused;
+            job.failed = &failed;
+            job.errors = &errors;
+            parallelFor(npairs, fusePairTask, &job);
+            first = false;
+            
+            // error state of the workers is thread local
+            for (int i = 0; i < npairs; i++) {
+                if (failed[i]) {
+                    setError(errors[i]);
+                    return 0;
+                }
+            }
+            
+            if (shapes.size() % 2)
+                fused.back() = shapes.back();
+            shapes.swap(fused);
+        }
+        
+        this->setShape(shapes[0]);
+        
+        // possible fix shape
+        if (!this->fixShape())
+            StdFail_NotDone::Raise("Shapes not valid");
+        
+    } catch(Standard_Failure &err) {
+        setFailure("OCCSolid::fuseAll", "Failed in boolean operation");
         return 0;
     }
     return 1;
@@ -908,20 +1525,21 @@ int OCCSolid::chamfer(std::vector<OCCEdge *> edges, std::vector<double> distance
         if (tmp.IsNull())
             StdFail_NotDone::Raise("Chamfer operaton return Null shape");
         
+        const bool tracked = this->hasHistory;
+        const bool wasValid = this->isKnownValid();
+        OCCShapeSet modified;
+        collectModified(CF, solid, modified);
+        
         this->setShape(tmp);
+        if (tracked)
+            this->addHistory(modified);
         
         // possible fix shape
-        if (!this->fixShape())
+        if (!(wasValid ? this->fixShape(modified) : this->fixShape()))
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to chamfer solid");
-        }
+        setFailure("OCCSolid::chamfer", "Failed to chamfer solid");
         return 0;
     }
     return 1;
@@ -975,20 +1593,21 @@ int OCCSolid::fillet(std::vector<OCCEdge *> edges, std::vector<double> radius) {
         if (tmp.IsNull())
             StdFail_NotDone::Raise("Fillet operation resulted in Null shape");
         
+        const bool tracked = this->hasHistory;
+        const bool wasValid = this->isKnownValid();
+        OCCShapeSet modified;
+        collectModified(fill, solid, modified);
+        
         this->setShape(tmp);
+        if (tracked)
+            this->addHistory(modified);
         
         // possible fix shape
-        if (!this->fixShape())
+        if (!(wasValid ? this->fixShape(modified) : this->fixShape()))
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to fillet solid");
-        }
+        setFailure("OCCSolid::fillet", "Failed to fillet solid");
         return 0;
     }
     return 1;
@@ -1021,13 +1640,7 @@ int OCCSolid::shell(std::vector<OCCFace *> faces, double offset, double toleranc
             StdFail_NotDone::Raise("Shapes not valid");
     
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to shell solid");
-        }
+        setFailure("OCCSolid::shell", "Failed to shell solid");
         return 0;
     }
     return 1;
@@ -1045,13 +1658,7 @@ int OCCSolid::offset(OCCFace *face, double offset, double tolerance = 1e-6) {
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to offset face");
-        }
+        setFailure("OCCSolid::offset", "Failed to offset face");
         return 0;
     }
     return 1;
@@ -1100,13 +1707,7 @@ OCCFace *OCCSolid::section(OCCStruct3d pnt, OCCStruct3d nor)
         ret->setShape(MFRes.Face());
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create section");
-        }
+        setFailure("OCCSolid::section", "Failed to create section");
         return NULL;
     }
     return ret;
@@ -1114,6 +1715,9 @@ OCCFace *OCCSolid::section(OCCStruct3d pnt, OCCStruct3d nor)
 
 void OCCSolid::setShape(TopoDS_Shape shape)
 {
+    this->hasHistory = false;
+    this->validState = VALID_UNKNOWN;
+    
     TopAbs_ShapeEnum type = shape.ShapeType();
     if (type == TopAbs_SOLID || type == TopAbs_COMPSOLID) {
         solid = shape;
@@ -1154,3 +1758,10 @@ void OCCSolid::setShape(TopoDS_Shape shape)
         }
     }
 }
+
+void OCCSolid::addHistory(const OCCShapeSet& modified)
+{
+    for (unsigned int i = 0; i < modified.shapes.size(); i++)
+        this->modifiedFaces.add(modified.shapes[i]);
+    this->hasHistory = true;
+}
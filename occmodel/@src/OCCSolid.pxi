@@ -84,20 +84,25 @@ cdef class Solid(Base):
         return occ.numFaces()
         
     cpdef Mesh createMesh(self, double factor = .01, double angle = .25,
-                          bint qualityNormals = False):
+                          bint qualityNormals = False, bint parallel = False):
         '''
         Create triangle mesh of solid.
         
         :param factor: deflection from true position
         :param angle: max angle
         :param qualityNormals: create normals by evaluating surface parameters
+        :param parallel: triangulate and extract faces in parallel threads
         '''
         cdef c_OCCSolid *occ = <c_OCCSolid *>self.thisptr
-        cdef c_OCCMesh *mesh = occ.createMesh(factor, angle, qualityNormals)
-        cdef Mesh ret = Mesh.__new__(Mesh, None)
+        cdef c_OCCMesh *mesh
+        cdef Mesh ret
+
+        with nogil:
+            mesh = occ.createMesh(factor, angle, qualityNormals, parallel)
+        ret = Mesh.__new__(Mesh, None)
         
         if mesh == NULL:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         ret.thisptr = mesh
         ret.setArrays()
@@ -119,9 +124,10 @@ cdef class Solid(Base):
         for face in faces:
             cfaces.push_back(<c_OCCFace *>face.thisptr)
         
-        ret = occ.createSolid(cfaces, tolerance)
+        with nogil:
+            ret = occ.createSolid(cfaces, tolerance)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -147,7 +153,7 @@ cdef class Solid(Base):
         
         ret = occ.addSolids(csolids)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -173,7 +179,7 @@ cdef class Solid(Base):
         
         ret = occ.createSphere(cen, radius)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
 
@@ -203,7 +209,7 @@ cdef class Solid(Base):
         
         ret = occ.createCylinder(cp1, cp2, radius)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
 
@@ -234,7 +240,7 @@ cdef class Solid(Base):
         
         ret = occ.createTorus(cp1, cp2, ringRadius, radius)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -265,7 +271,7 @@ cdef class Solid(Base):
         
         ret = occ.createCone(cp1, cp2, radius1, radius2)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -291,7 +297,7 @@ cdef class Solid(Base):
         
         ret = occ.createBox(cp1, cp2)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -316,7 +322,7 @@ cdef class Solid(Base):
             ret = occ.createText(height, depth, c_str, fontpath)
             
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -345,7 +351,7 @@ cdef class Solid(Base):
         
         ret = occ.createPrism(<c_OCCFace *>face.thisptr, cnormal, isInfinite)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -418,9 +424,10 @@ cdef class Solid(Base):
         cp2.y = p2[1]
         cp2.z = p2[2]
         
-        ret = occ.extrude(<c_OCCFace *>face.thisptr, cp1, cp2)
+        with nogil:
+            ret = occ.extrude(<c_OCCFace *>face.thisptr, cp1, cp2)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -450,9 +457,10 @@ cdef class Solid(Base):
         cp2.y = p2[1]
         cp2.z = p2[2]
         
-        ret = occ.revolve(<c_OCCFace *>face.thisptr, cp1, cp2, angle)
+        with nogil:
+            ret = occ.revolve(<c_OCCFace *>face.thisptr, cp1, cp2, angle)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -503,10 +511,11 @@ cdef class Solid(Base):
             cobj = obj
             cprofiles.push_back((<c_OCCBase *>cobj.thisptr))
         
-        ret = occ.sweep(<c_OCCWire *>cspine.thisptr, cprofiles, cornerMode)
+        with nogil:
+            ret = occ.sweep(<c_OCCWire *>cspine.thisptr, cprofiles, cornerMode)
         
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -543,10 +552,11 @@ cdef class Solid(Base):
             cobj = obj
             cprofiles.push_back((<c_OCCBase *>cobj.thisptr))
         
-        ret = occ.loft(cprofiles, ruled, tolerance)
+        with nogil:
+            ret = occ.loft(cprofiles, ruled, tolerance)
         
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -572,15 +582,17 @@ cdef class Solid(Base):
         else:
             wire = path
                 
-        ret = occ.pipe(<c_OCCFace *>face.thisptr, <c_OCCWire *>wire.thisptr)
+        with nogil:
+            ret = occ.pipe(<c_OCCFace *>face.thisptr, <c_OCCWire *>wire.thisptr)
             
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
-    cdef boolean(self, arg, c_BoolOpType op):
+    cdef boolean(self, arg, c_BoolOpType op, bint slabs = False):
         cdef c_OCCSolid *occ = <c_OCCSolid *>self.thisptr
+        cdef vector[c_OCCSolid *] tools
         cdef Solid tool
         cdef int ret
         
@@ -630,18 +642,25 @@ cdef class Solid(Base):
             if not solids:
                 raise OCCError('No objects created')
             
-            # create compound of solid objects
-            tool = Solid().addSolids(solids)
+            for tool in solids:
+                tools.push_back(<c_OCCSolid *>tool.thisptr)
         else:
             tool = arg
+            tools.push_back(<c_OCCSolid *>tool.thisptr)
         
-        if op in (BOOL_FUSE, BOOL_CUT, BOOL_COMMON):
-            ret = occ.boolean(<c_OCCSolid *>tool.thisptr, op)
-        else:
+        if not op in (BOOL_FUSE, BOOL_CUT, BOOL_COMMON):
             raise OCCError('uknown operation')
         
+        if not isinstance(arg, (tuple,list,set)):
+            with nogil:
+                ret = occ.boolean(tools[0], op)
+        else:
+            # all tools in one pass
+            with nogil:
+                ret = occ.booleanMany(tools, op, slabs)
+        
         if not ret:
-            raise OCCError('Failed to create boolean %s' % op)
+            raise lastError()
         
         return self
         
@@ -653,11 +672,45 @@ cdef class Solid(Base):
         '''
         return self.boolean(arg, BOOL_FUSE)
         
-    cpdef cut(self, arg):
+    cpdef fuseAll(self, solids, bint sort = True):
+        '''
+        Fuse sequence of solids inplace.
+        
+        The solids are fused pairwise in a balanced tree, with
+        the pairs of each level fused in parallel.
+        
+        :param solids: sequence of solids
+        :param sort: fuse spatial neighbours first
+        '''
+        cdef c_OCCSolid *occ = <c_OCCSolid *>self.thisptr
+        cdef vector[c_OCCSolid *] cvec
+        cdef Solid solid
+        cdef int ret
+        
+        for solid in solids:
+            cvec.push_back(<c_OCCSolid *>solid.thisptr)
+        
+        with nogil:
+            ret = occ.fuseAll(cvec, sort)
+            
+        if not ret:
+            raise lastError()
+            
+        return self
+        
+    cpdef cut(self, arg, bint slabs = False):
         '''
         Create boolean difference inplace.
         
-        Multiple objects are supported.
+        Multiple objects are supported. A sequence of objects is
+        cut in one pass, where solids in compounds are used as
+        separate tools.
+        
+        With slabs set, tools in independent regions of the solid
+        are cut from slabs of it in parallel. The faces split at the
+        slab borders are merged again together with any other faces
+        on the same surface, so the topology can differ from the
+        single pass.
         
         Edges, wires and faces are extruded in the normal
         directions to intersect the solid.
@@ -665,7 +718,7 @@ cdef class Solid(Base):
         Edges and wires allways cut through all, but faces
         are limited by the face itself.
         '''
-        return self.boolean(arg, BOOL_CUT)
+        return self.boolean(arg, BOOL_CUT, slabs)
         
     cpdef common(self, arg):
         '''
@@ -711,10 +764,11 @@ cdef class Solid(Base):
         for r in radius:
             cradius.push_back(r)
         
-        ret = occ.fillet(cedges, cradius)
+        with nogil:
+            ret = occ.fillet(cedges, cradius)
             
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         return self
         
@@ -748,10 +802,11 @@ cdef class Solid(Base):
         for dist in distances:
             cdistances.push_back(dist)
         
-        ret = occ.chamfer(cedges, cdistances)
+        with nogil:
+            ret = occ.chamfer(cedges, cdistances)
             
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         return self
         
@@ -777,10 +832,11 @@ cdef class Solid(Base):
         for face in faces:
             cfaces.push_back((<c_OCCFace *>face.thisptr))
         
-        ret = occ.shell(cfaces, offset, tolerance)
+        with nogil:
+            ret = occ.shell(cfaces, offset, tolerance)
             
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         return self
 
@@ -794,9 +850,10 @@ cdef class Solid(Base):
         cdef c_OCCSolid *occ = <c_OCCSolid *>self.thisptr
         cdef int ret
         
-        ret = occ.offset(<c_OCCFace *>face.thisptr, offset, tolerance)
+        with nogil:
+            ret = occ.offset(<c_OCCFace *>face.thisptr, offset, tolerance)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         return self
         
@@ -820,9 +877,10 @@ cdef class Solid(Base):
         cnor.y = plane.zaxis.y
         cnor.z = plane.zaxis.z
         
-        ret.thisptr = occ.section(cpnt, cnor)
+        with nogil:
+            ret.thisptr = occ.section(cpnt, cnor)
         if ret.thisptr == NULL:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return ret
 
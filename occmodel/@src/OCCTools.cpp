@@ -2,6 +2,25 @@
 // See LICENSE.txt for details on conditions.
 #include "OCCModel.h"
 
+// Interface_Static settings are process wide and not thread safe.
+// They are set once, before the first reader or writer use them.
+static Standard_Mutex staticMutex;
+static bool staticConfigured = false;
+
+// STEP transfers use the actors registered with the controllers and
+// the process global unit factors, so they hold this mutex.
+static Standard_Mutex transferMutex;
+
+static void configureStatic()
+{
+    Standard_Mutex::Sentry sentry(staticMutex);
+    if (staticConfigured)
+        return;
+    Interface_Static::SetCVal("xstep.cascade.unit","M");
+    Interface_Static::SetIVal("read.step.nonmanifold", 1);
+    staticConfigured = true;
+}
+
 void printShapeType(const TopoDS_Shape& shape)
 {
     if (!shape.IsNull()) {
@@ -42,117 +61,182 @@ void printShapeType(const TopoDS_Shape& shape)
     }
 }
 
-int extractSubShape(const TopoDS_Shape& shape, std::vector<OCCBase *>& shapes)
+// Create object of matching type for shape, NULL for compounds
+OCCBase *newShape(const TopoDS_Shape& shape)
 {
-    TopAbs_ShapeEnum type = shape.ShapeType();
-    switch (type)
+    OCCBase *ret;
+    switch (shape.ShapeType())
     {
-    case TopAbs_COMPOUND:
-        return 0;
     case TopAbs_COMPSOLID:
     case TopAbs_SOLID:
-    {
-        OCCSolid *ret = new OCCSolid();
-        ret->setShape(shape);
-        if (!ret->fixShape()) {
-            delete ret;
-            return 0;
-        }
-        shapes.push_back((OCCBase *)ret);
+        ret = new OCCSolid();
         break;
-    }
     case TopAbs_FACE:
     case TopAbs_SHELL:
-    {
-        OCCFace *ret = new OCCFace();
-        ret->setShape(shape);
-        if (!ret->fixShape()) {
-            delete ret;
-            return 0;
-        }
-        shapes.push_back((OCCBase *)ret);
+        ret = new OCCFace();
         break;
-    }
     case TopAbs_WIRE:
-    {
-        OCCWire *ret = new OCCWire();
-        ret->setShape(shape);
-        if (!ret->fixShape()) {
-            delete ret;
-            return 0;
-        }
-        shapes.push_back((OCCBase *)ret);
+        ret = new OCCWire();
         break;
-    }
     case TopAbs_EDGE:
-    {
-        OCCEdge *ret = new OCCEdge();
-        ret->setShape(shape);
-        if (!ret->fixShape()) {
-            delete ret;
-            return 0;
-        }
-        shapes.push_back((OCCBase *)ret);
+        ret = new OCCEdge();
         break;
-    }
     case TopAbs_VERTEX:
-    {
-        OCCVertex *ret = new OCCVertex();
-        ret->setShape(shape);
-        if (!ret->fixShape()) {
-            delete ret;
-            return 0;
-        }
-        shapes.push_back((OCCBase *)ret);
+        ret = new OCCVertex();
         break;
-    }
     default:
+        return NULL;
+    }
+    ret->setShape(shape);
+    return ret;
+}
+
+int extractSubShape(const TopoDS_Shape& shape, std::vector<OCCBase *>& shapes)
+{
+    OCCBase *ret = newShape(shape);
+    if (ret == NULL)
+        return 0;
+    if (!ret->fixShape()) {
+        delete ret;
         return 0;
     }
+    shapes.push_back(ret);
     return 1;
 }
-    
-int extractShape(const TopoDS_Shape& shape, std::vector<OCCBase *>& shapes)
+
+// Collect sub shapes of shape in the order they are extracted
+static void collectSubShapes(const TopoDS_Shape& shape, std::vector<TopoDS_Shape>& subshapes)
 {
-    TopAbs_ShapeEnum type = shape.ShapeType();
-    
-    if (type != TopAbs_COMPOUND) {
-        extractSubShape(shape, shapes);
-        return 0;
+    if (shape.ShapeType() != TopAbs_COMPOUND) {
+        subshapes.push_back(shape);
+        return;
     }
     
     TopExp_Explorer ex;
-    int ret = 0;
-    
-    // extract compund
-    for (ex.Init(shape, TopAbs_COMPOUND); ex.More(); ex.Next())
-        ret += extractSubShape(ex.Current(), shapes);
     
     // extract solids
     for (ex.Init(shape, TopAbs_COMPSOLID); ex.More(); ex.Next())
-        ret += extractSubShape(ex.Current(), shapes);
+        subshapes.push_back(ex.Current());
     for (ex.Init(shape, TopAbs_SOLID); ex.More(); ex.Next())
-        ret += extractSubShape(ex.Current(), shapes);
+        subshapes.push_back(ex.Current());
     
     // extract free faces
     for (ex.Init(shape, TopAbs_SHELL, TopAbs_SOLID); ex.More(); ex.Next())
-        ret += extractSubShape(ex.Current(), shapes);
+        subshapes.push_back(ex.Current());
     for (ex.Init(shape, TopAbs_FACE, TopAbs_SOLID); ex.More(); ex.Next())
-        ret += extractSubShape(ex.Current(), shapes);
+        subshapes.push_back(ex.Current());
     
     // extract free wires
     for (ex.Init(shape, TopAbs_WIRE, TopAbs_FACE); ex.More(); ex.Next())
-        ret += extractSubShape(ex.Current(), shapes);
+        subshapes.push_back(ex.Current());
     
     // extract free edges
     for (ex.Init(shape, TopAbs_EDGE, TopAbs_WIRE); ex.More(); ex.Next())
-        ret += extractSubShape(ex.Current(), shapes);
+        subshapes.push_back(ex.Current());
         
     // extract free vertices
     for (ex.Init(shape, TopAbs_VERTEX, TopAbs_EDGE); ex.More(); ex.Next())
-        ret += extractSubShape(ex.Current(), shapes);
+        subshapes.push_back(ex.Current());
+}
+
+static double elapsedTime(OSD_Timer& timer)
+{
+    Standard_Real seconds, cpu;
+    Standard_Integer minutes, hours;
+    timer.Show(seconds, minutes, hours, cpu);
+    return 3600.*hours + 60.*minutes + seconds;
+}
+
+struct CheckShapesJob {
+    std::vector<OCCBase *> *shapes;
+    std::vector<OCCShapeReport> *report;
+};
+
+static void checkShapeTask(void *data, int index) {
+    CheckShapesJob *job = (CheckShapesJob *)data;
+    OSD_Timer timer;
+    timer.Start();
+    try {
+        // result is cached in the shape
+        (*job->shapes)[index]->isValid();
+    } catch(Standard_Failure &err) {
+        // checked again by fixShape
+    }
+    timer.Stop();
+    (*job->report)[index].checkTime = elapsedTime(timer);
+}
+
+// Create objects from sub shapes. The shapes are checked in parallel,
+// while shapes in need of healing are fixed one by one, as ShapeFix
+// changes tolerances of sub shapes in place which may be shared by
+// several shapes.
+static int extractShapes(const std::vector<TopoDS_Shape>& subshapes,
+                         std::vector<OCCBase *>& shapes,
+                         std::vector<OCCShapeReport> *report)
+{
+    std::vector<OCCBase *> created;
+    std::vector<OCCShapeReport> info;
+    for (unsigned int i = 0; i < subshapes.size(); i++) {
+        OCCBase *ret = newShape(subshapes[i]);
+        if (ret == NULL)
+            continue;
+        created.push_back(ret);
+        
+        OCCShapeReport entry;
+        entry.type = subshapes[i].ShapeType();
+        entry.index = -1;
+        entry.checked = !OCCBase::isTrusted();
+        entry.valid = false;
+        entry.fixed = false;
+        entry.checkTime = 0.;
+        entry.fixTime = 0.;
+        info.push_back(entry);
+    }
     
-    return ret;
+    const bool checked = !OCCBase::isTrusted();
+    if (checked) {
+        CheckShapesJob job;
+        job.shapes = &created;
+        job.report = &info;
+        parallelFor(created.size(), checkShapeTask, &job);
+    }
+    
+    int count = 0;
+    for (unsigned int i = 0; i < created.size(); i++) {
+        OCCBase *ret = created[i];
+        info[i].valid = checked && ret->isKnownValid();
+        
+        OSD_Timer timer;
+        timer.Start();
+        const bool ok = ret->fixShape();
+        timer.Stop();
+        
+        // in trusted mode fixShape neither checks nor heals
+        if (checked && !info[i].valid) {
+            info[i].fixTime = elapsedTime(timer);
+            info[i].fixed = ok;
+        }
+        
+        if (!ok) {
+            delete ret;
+            continue;
+        }
+        info[i].index = shapes.size();
+        shapes.push_back(ret);
+        count++;
+    }
+    
+    if (report != NULL)
+        report->insert(report->end(), info.begin(), info.end());
+    return count;
+}
+    
+int extractShape(const TopoDS_Shape& shape, std::vector<OCCBase *>& shapes,
+                 std::vector<OCCShapeReport> *report)
+{
+    std::vector<TopoDS_Shape> subshapes;
+    collectSubShapes(shape, subshapes);
+    return extractShapes(subshapes, shapes, report);
 }
 
 int OCCTools::writeBREP(const char *filename, std::vector<OCCBase *> shapes)
@@ -166,14 +250,7 @@ int OCCTools::writeBREP(const char *filename, std::vector<OCCBase *> shapes)
         }
         BRepTools::Write(C, filename);
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        //printf("ERROR: %s\n", e->GetMessageString());
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to write BREP file");
-        }
+        setFailure("OCCTools::writeBREP", "Failed to write BREP file");
         return 0;
     }
     return 1;
@@ -191,25 +268,57 @@ int OCCTools::writeSTEP(const char *filename, std::vector<OCCBase *> shapes)
         STEPControl_Writer writer;
         IFSelect_ReturnStatus status;
         
-        Interface_Static::SetCVal("xstep.cascade.unit","M");
-        Interface_Static::SetIVal("read.step.nonmanifold", 1);
+        configureStatic();
         
-        for (unsigned i = 0; i < shapes.size(); i++) {
-            status = writer.Transfer(shapes[i]->getShape(), STEPControl_AsIs);
+        {
+            // the write actor is shared by all writers
+            Standard_Mutex::Sentry sentry(transferMutex);
+            for (unsigned i = 0; i < shapes.size(); i++) {
+                status = writer.Transfer(shapes[i]->getShape(), STEPControl_AsIs);
+                if (status != IFSelect_RetDone) {
+                    StdFail_NotDone::Raise("Failed to write STEP file");
+                }
+            }
+        }
+        status = writer.Write(filename);
+        if (status != IFSelect_RetDone) {
+            StdFail_NotDone::Raise("Failed to write STEP file");
+        }
+    } catch(Standard_Failure &err) {
+        setFailure("OCCTools::writeSTEP", "Failed to write STEP file");
+        return 0;
+    }
+    return 1;
+}
+
+// Write single shape. With assembly shapes shared with different
+// locations are written as instances of one product.
+int OCCTools::writeSTEP(const char *filename, const TopoDS_Shape& shape, bool assembly)
+{
+    try {
+        STEPControl_Writer writer;
+        IFSelect_ReturnStatus status;
+        
+        configureStatic();
+        
+        {
+            // the group mode is read from the static by Transfer,
+            // and all STEP transfers hold the transfer mutex.
+            Standard_Mutex::Sentry sentry(transferMutex);
+            const int mode = Interface_Static::IVal("write.step.assembly");
+            Interface_Static::SetIVal("write.step.assembly", assembly ? 1 : mode);
+            status = writer.Transfer(shape, STEPControl_AsIs);
+            Interface_Static::SetIVal("write.step.assembly", mode);
             if (status != IFSelect_RetDone) {
                 StdFail_NotDone::Raise("Failed to write STEP file");
             }
         }
         status = writer.Write(filename);
-    } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        //printf("ERROR: %s\n", e->GetMessageString());
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to write STEP file");
+        if (status != IFSelect_RetDone) {
+            StdFail_NotDone::Raise("Failed to write STEP file");
         }
+    } catch(Standard_Failure &err) {
+        setFailure("OCCTools::writeSTEP", "Failed to write STEP file");
         return 0;
     }
     return 1;
@@ -228,14 +337,7 @@ int OCCTools::writeSTL(const char *filename, std::vector<OCCBase *> shapes)
         StlAPI_Writer writer;
         writer.Write(shape, filename);
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        //printf("ERROR: %s\n", e->GetMessageString());
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to write STL file");
-        }
+        setFailure("OCCTools::writeSTL", "Failed to write STL file");
         return 0;
     }
     return 1;
@@ -254,38 +356,40 @@ int OCCTools::writeVRML(const char *filename, std::vector<OCCBase *> shapes)
         VrmlAPI_Writer writer;
         writer.Write(shape, filename);
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        //printf("ERROR: %s\n", e->GetMessageString());
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to write VRML file");
-        }
+        setFailure("OCCTools::writeVRML", "Failed to write VRML file");
         return 0;
     }
     return 1;
 }
 
-int OCCTools::readBREP(const char *filename, std::vector<OCCBase *>& shapes)
+int OCCTools::readBREP(const char *filename, std::vector<OCCBase *>& shapes,
+                       std::vector<OCCShapeReport> *report = NULL)
 {
     try {
         // read brep-file
         TopoDS_Shape shape;
         BRep_Builder aBuilder;
-        if (!BRepTools::Read(shape, filename, aBuilder)) {
-            StdFail_NotDone::Raise("Failed to read BFREP file");
-        }
-        extractShape(shape, shapes);
-    } catch (Standard_Failure) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        //printf("ERROR: %s\n", e->GetMessageString());
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
+        OCCMappedFile file;
+        if (!file.open(filename, true)) {
+            // fall back to file stream
+            if (!BRepTools::Read(shape, filename, aBuilder)) {
+                StdFail_NotDone::Raise("Failed to read BFREP file");
+            }
+        } else if (isBinary(file.data, file.size)) {
+            if (!readBinary(file.data, file.size, shape))
+                return 0;
         } else {
-            setErrorMessage("Failed to read BREP file");
+            // parse directly from the mapped pages
+            OCCMemoryBuffer buffer(file.data, file.size);
+            std::istream str(&buffer);
+            BRepTools::Read(shape, str, aBuilder);
+            if (shape.IsNull()) {
+                StdFail_NotDone::Raise("Failed to read BFREP file");
+            }
         }
+        extractShape(shape, shapes, report);
+    } catch (Standard_Failure) {
+        setFailure("OCCTools::readBREP", "Failed to read BREP file");
         return 0;
     }
     return 1;
@@ -298,55 +402,610 @@ int OCCTools::readBREP(std::istream& str, TopoDS_Shape& shape)
         BRep_Builder aBuilder;
         BRepTools::Read(shape, str, aBuilder);
     } catch (Standard_Failure) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        //printf("ERROR: %s\n", e->GetMessageString());
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
+        setFailure("OCCTools::readBREP", "Failed to read BREP file");
+        return 0;
+    }
+    return 1;
+}
+
+// Binary shape format. The header holds the magic, the format version,
+// flags and the size of the BinTools data, followed by the data itself
+// or the compressed block.
+static const char binaryMagic[4] = {'O', 'C', 'C', 'B'};
+static const unsigned char binaryVersion = 1;
+static const unsigned char binaryCompressed = 1;
+static const size_t binaryHeaderSize = 16;
+
+bool OCCTools::isBinary(const char *input, size_t size)
+{
+    return size >= binaryHeaderSize &&
+           memcmp(input, binaryMagic, 4) == 0;
+}
+
+static void writeBinaryHeader(char *header, unsigned long long size, bool compress)
+{
+    memset(header, 0, binaryHeaderSize);
+    memcpy(header, binaryMagic, 4);
+    header[4] = binaryVersion;
+    header[5] = compress ? binaryCompressed : 0;
+    
+    // size as 64 bit little endian
+    for (int i = 0; i < 8; i++)
+        header[8 + i] = (char)((size >> (8*i)) & 0xff);
+}
+
+int OCCTools::writeBinary(std::string& output, const TopoDS_Shape& shape, bool compress)
+{
+    try {
+        std::stringstream str;
+        BinTools_ShapeSet set;
+        set.Add(shape);
+        set.Write(str);
+        set.Write(shape, str);
+        const std::string data = str.str();
+        
+        char header[binaryHeaderSize];
+        writeBinaryHeader(header, data.size(), compress);
+        
+        output.assign(header, binaryHeaderSize);
+        if (compress) {
+            std::string block;
+            compressBlock(data.data(), data.size(), block);
+            output.append(block);
         } else {
-            setErrorMessage("Failed to read BREP file");
+            output.append(data);
         }
+    } catch(Standard_Failure &err) {
+        setFailure("OCCTools::writeBinary", "Failed to write binary shape");
         return 0;
     }
     return 1;
 }
 
-int OCCTools::readSTEP(const char *filename, std::vector<OCCBase *>& shapes)
+// Write uncompressed binary shape straight into memory from allocate.
+// A first pass over the data only counts its size, such that the data
+// is not buffered and copied.
+int OCCTools::writeBinary(const TopoDS_Shape& shape, OCCAllocateFunction allocate, void *data)
+{
+    try {
+        BinTools_ShapeSet set;
+        set.Add(shape);
+        
+        OCCCountingBuffer counter;
+        std::ostream countStr(&counter);
+        set.Write(countStr);
+        set.Write(shape, countStr);
+        const size_t size = counter.count;
+        
+        char *output = allocate(binaryHeaderSize + size, data);
+        if (output == NULL)
+            return 0;
+        writeBinaryHeader(output, size, false);
+        
+        OCCMemoryWriteBuffer buffer(output + binaryHeaderSize, size);
+        std::ostream str(&buffer);
+        set.Write(str);
+        set.Write(shape, str);
+        if (!str || buffer.written() != size) {
+            StdFail_NotDone::Raise("Binary data size changed");
+        }
+    } catch(Standard_Failure &err) {
+        setFailure("OCCTools::writeBinary", "Failed to write binary shape");
+        return 0;
+    }
+    return 1;
+}
+
+int OCCTools::readBinary(const char *input, size_t inputSize, TopoDS_Shape& shape)
+{
+    try {
+        if (!isBinary(input, inputSize) || (unsigned char)input[4] != binaryVersion) {
+            StdFail_NotDone::Raise("Unknown binary format");
+        }
+        
+        unsigned long long size = 0;
+        for (int i = 0; i < 8; i++)
+            size |= (unsigned long long)(unsigned char)input[8 + i] << (8*i);
+        
+        // uncompressed data is read in place
+        std::vector<char> data;
+        const char *payload = input + binaryHeaderSize;
+        size_t payloadSize = inputSize - binaryHeaderSize;
+        if (input[5] & binaryCompressed) {
+            // each byte of a block expands to at most 255 bytes
+            if (size > 255ULL*payloadSize) {
+                StdFail_NotDone::Raise("Corrupt binary data");
+            }
+            data.resize((size_t)size + 1);
+            if (!decompressBlock(payload, payloadSize, &data[0], (size_t)size)) {
+                StdFail_NotDone::Raise("Corrupt binary data");
+            }
+            payload = &data[0];
+            payloadSize = (size_t)size;
+        } else if (size != payloadSize) {
+            StdFail_NotDone::Raise("Corrupt binary data");
+        }
+        
+        OCCMemoryBuffer buffer(payload, payloadSize);
+        std::istream str(&buffer);
+        BinTools_ShapeSet set;
+        set.Read(str);
+        set.Read(shape, str, set.NbShapes());
+    } catch(Standard_Failure &err) {
+        setFailure("OCCTools::readBinary", "Failed to read binary shape");
+        return 0;
+    }
+    return 1;
+}
+
+struct TransferRootsJob {
+    Handle(Interface_InterfaceModel) model;
+    int nroots;
+    int nworkers;
+    std::vector<TopoDS_Shape> *results;
+    std::vector<char> *failed;
+    std::vector<OCCErrorInfo> *errors;
+};
+
+// Transfer every nworkers root starting at index. The parsed model is
+// shared, while each worker use its own work session, transfer process
+// and actor as the actor registered with the STEP controller is shared
+// by all readers.
+static void transferRootsTask(void *data, int index) {
+    TransferRootsJob *job = (TransferRootsJob *)data;
+    try {
+        STEPControl_Reader reader;
+        reader.WS()->SetModel(job->model);
+        reader.WS()->TransferReader()->SetModel(job->model);
+        reader.WS()->TransferReader()->SetActor(new STEPControl_ActorRead);
+        
+        if (reader.NbRootsForTransfer() != job->nroots) {
+            StdFail_NotDone::Raise("Root count mismatch");
+        }
+        
+        for (int n = index + 1; n <= job->nroots; n += job->nworkers) {
+            const int nbs = reader.NbShapes();
+            reader.TransferRoot(n);
+            if (reader.NbShapes() > nbs)
+                (*job->results)[n - 1] = reader.Shape(reader.NbShapes());
+        }
+    } catch(Standard_Failure &err) {
+        setFailure("OCCTools::readSTEP", "Failed to transfer STEP roots");
+        (*job->failed)[index] = 1;
+        (*job->errors)[index] = *getErrorInfo();
+    }
+}
+
+// The actor sets the unit factors of each representation context in
+// the process global UnitsMethods before translating it. Workers can
+// only share these when every context of the model has the same units,
+// such that all of them store the same factors.
+static bool hasUniformUnits(const Handle(Interface_InterfaceModel)& model) {
+    bool first = true;
+    double length = 1., plane = 1., solid = 1.;
+    
+    for (int i = 1; i <= model->NbEntities(); i++) {
+        Handle(StepRepr_RepresentationContext) context =
+            Handle(StepRepr_RepresentationContext)::DownCast(model->Value(i));
+        if (context.IsNull())
+            continue;
+        
+        Handle(StepRepr_GlobalUnitAssignedContext) units =
+            Handle(StepRepr_GlobalUnitAssignedContext)::DownCast(context);
+        if (units.IsNull()) {
+            Handle(StepGeom_GeometricRepresentationContextAndGlobalUnitAssignedContext) geom =
+                Handle(StepGeom_GeometricRepresentationContextAndGlobalUnitAssignedContext)::DownCast(context);
+            Handle(StepGeom_GeomRepContextAndGlobUnitAssCtxAndGlobUncertaintyAssCtx) geomunc =
+                Handle(StepGeom_GeomRepContextAndGlobUnitAssCtxAndGlobUncertaintyAssCtx)::DownCast(context);
+            if (!geom.IsNull())
+                units = geom->GlobalUnitAssignedContext();
+            else if (!geomunc.IsNull())
+                units = geomunc->GlobalUnitAssignedContext();
+        }
+        
+        STEPConstruct_UnitContext unit;
+        if (!units.IsNull() && unit.ComputeFactors(units) != 0)
+            return false;
+        
+        if (first) {
+            length = unit.LengthFactor();
+            plane = unit.PlaneAngleFactor();
+            solid = unit.SolidAngleFactor();
+            first = false;
+        } else if (unit.LengthFactor() != length ||
+                   unit.PlaneAngleFactor() != plane ||
+                   unit.SolidAngleFactor() != solid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int OCCTools::readSTEP(const char *filename, std::vector<OCCBase *>& shapes,
+                       std::vector<OCCShapeReport> *report = NULL,
+                       int threads = 1)
 {
     try {
         STEPControl_Reader aReader;
         
-        Interface_Static::SetCVal("xstep.cascade.unit","M");
-        Interface_Static::SetIVal("read.step.nonmanifold", 1);
+        configureStatic();
         
         if (aReader.ReadFile(filename) != IFSelect_RetDone) {
             StdFail_NotDone::Raise("Failed to read STEP file");
         }
         
-        // Root transfers
         int nbr = aReader.NbRootsForTransfer();
-        for (int n = 1; n<= nbr; n++) {
-            aReader.TransferRoot(n);
+        if (threads <= 0)
+            threads = numThreads();
+        threads = std::min(threads, nbr);
+        if (threads > 1 && !hasUniformUnits(aReader.WS()->Model()))
+            threads = 1;
+        
+        std::vector<TopoDS_Shape> roots;
+        if (threads > 1) {
+            // Root transfers partitioned between workers
+            roots.resize(nbr);
+            
+            std::vector<char> failed(threads, 0);
+            std::vector<OCCErrorInfo> errors(threads);
+            
+            TransferRootsJob job;
+            job.model = aReader.WS()->Model();
+            job.nroots = nbr;
+            job.nworkers = threads;
+            job.results = &roots;
+            job.failed = &failed;
+            job.errors = &errors;
+            {
+                // the workers use their own actors, but the unit
+                // factors are process global and other readers may
+                // use different units.
+                Standard_Mutex::Sentry sentry(transferMutex);
+                parallelFor(threads, transferRootsTask, &job, threads);
+            }
+            
+            for (int i = 0; i < threads; i++) {
+                if (failed[i]) {
+                    setError(errors[i]);
+                    return 0;
+                }
+            }
+        } else {
+            // Root transfers, the read actor and the unit factors
+            // are shared by all readers.
+            {
+                Standard_Mutex::Sentry sentry(transferMutex);
+                for (int n = 1; n<= nbr; n++) {
+                    aReader.TransferRoot(n);
+                }
+            }
+            
+            // Collecting resulting entities
+            int nbs = aReader.NbShapes();
+            for (int i=1; i<=nbs; i++) {
+                roots.push_back(aReader.Shape(i));
+            }
+        }
+        
+        // merged in root order
+        std::vector<TopoDS_Shape> subshapes;
+        for (unsigned int i = 0; i < roots.size(); i++) {
+            if (!roots[i].IsNull())
+                collectSubShapes(roots[i], subshapes);
+        }
+        extractShapes(subshapes, shapes, report);
+    } catch(Standard_Failure &err) {
+        setFailure("OCCTools::readSTEP", "Failed to read STEP file");
+        return 0;
+    }
+    return 1;
+}
+
+// Read all roots of STEP file into a compound without extracting
+// the shapes, such that shared shapes are kept.
+int OCCTools::readSTEP(const char *filename, TopoDS_Shape& shape)
+{
+    try {
+        STEPControl_Reader aReader;
+        
+        configureStatic();
+        
+        if (aReader.ReadFile(filename) != IFSelect_RetDone) {
+            StdFail_NotDone::Raise("Failed to read STEP file");
         }
         
-        // Collecting resulting entities
-        int nbs = aReader.NbShapes();
-        if (nbs == 0) return 1;
+        {
+            // the read actor and the unit factors are shared by
+            // all readers
+            Standard_Mutex::Sentry sentry(transferMutex);
+            aReader.TransferRoots();
+        }
         
-        for (int i=1; i<=nbs; i++) {
-            const TopoDS_Shape& aShape = aReader.Shape(i);
-            extractShape(aShape, shapes);
+        BRep_Builder B;
+        TopoDS_Compound C;
+        B.MakeCompound(C);
+        for (int i = 1; i <= aReader.NbShapes(); i++) {
+            B.Add(C, aReader.Shape(i));
         }
+        shape = C;
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        //printf("ERROR: %s\n", e->GetMessageString());
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to read STEP file");
+        setFailure("OCCTools::readSTEP", "Failed to read STEP file");
+        return 0;
+    }
+    return 1;
+}
+
+OCCStepReader::~OCCStepReader()
+{
+    for (unsigned int i = pos; i < pending.size(); i++)
+        delete pending[i];
+}
+
+int OCCStepReader::open(const char *filename)
+{
+    try {
+        configureStatic();
+        
+        if (reader.ReadFile(filename) != IFSelect_RetDone) {
+            StdFail_NotDone::Raise("Failed to read STEP file");
         }
+        
+        nroots = reader.NbRootsForTransfer();
+        root = 1;
+    } catch(Standard_Failure &err) {
+        setFailure("OCCStepReader::open", "Failed to read STEP file");
         return 0;
     }
     return 1;
 }
+
+int OCCStepReader::transferRoot()
+{
+    try {
+        {
+            // the read actor and the unit factors are shared by
+            // all readers
+            Standard_Mutex::Sentry sentry(transferMutex);
+            reader.TransferRoot(root++);
+        }
+        
+        std::vector<TopoDS_Shape> subshapes;
+        for (int i = 1; i <= reader.NbShapes(); i++)
+            collectSubShapes(reader.Shape(i), subshapes);
+        
+        // release transfer results and the transient process
+        // before the next root. Entities shared between roots
+        // are then translated again for each root.
+        reader.ClearShapes();
+        reader.WS()->TransferReader()->Clear(2);
+        
+        extractShapes(subshapes, pending, NULL);
+    } catch(Standard_Failure &err) {
+        failed = true;
+        setFailure("OCCStepReader::next", "Failed to transfer STEP root");
+        return 0;
+    }
+    return 1;
+}
+
+OCCBase *OCCStepReader::next()
+{
+    failed = false;
+    
+    // drop handed out shapes
+    if (pos > 0 && pos == pending.size()) {
+        pending.clear();
+        pos = 0;
+    }
+    
+    while (pos == pending.size() && root <= nroots) {
+        if (!transferRoot())
+            return NULL;
+    }
+    
+    if (pos == pending.size())
+        return NULL;
+    return pending[pos++];
+}
+
+struct ExportJobs {
+    std::vector<OCCExportJob> *jobs;
+    std::vector<unsigned int> *indices;
+};
+
+// The STL and VRML writers mesh the shape, which stores triangulations
+// in the faces. These are shared by jobs repeating a shape and by copies
+// moved by location, so these formats are not run on the workers.
+static bool isMeshingFormat(int format) {
+    return format == EXPORT_STL || format == EXPORT_VRML;
+}
+
+static void exportJob(OCCExportJob& job) {
+    std::vector<OCCBase *> shapes(1, job.shape);
+    
+    OSD_Timer timer;
+    timer.Start();
+    int ret = 0;
+    switch (job.format) {
+    case EXPORT_BREP:
+        ret = OCCTools::writeBREP(job.filename, shapes);
+        break;
+    case EXPORT_BINARY:
+        {
+            std::string output;
+            ret = job.shape->toString(&output, true, true);
+            if (ret) {
+                std::ofstream file(job.filename, std::ios::out | std::ios::binary);
+                file.write(output.data(), output.size());
+                file.close();
+                if (!file) {
+                    setError("OCCTools::exportMany", "", "Failed to write file");
+                    ret = 0;
+                }
+            }
+        }
+        break;
+    case EXPORT_STEP:
+        ret = OCCTools::writeSTEP(job.filename, shapes);
+        break;
+    case EXPORT_STL:
+        ret = OCCTools::writeSTL(job.filename, shapes);
+        break;
+    case EXPORT_VRML:
+        ret = OCCTools::writeVRML(job.filename, shapes);
+        break;
+    default:
+        setError("OCCTools::exportMany", "", "Unknown export format");
+    }
+    timer.Stop();
+    
+    job.status = ret;
+    job.time = elapsedTime(timer);
+    job.message[0] = '\0';
+    if (!ret) {
+        strncpy(job.message, getErrorInfo()->message, sizeof(job.message) - 1);
+        job.message[sizeof(job.message) - 1] = '\0';
+    }
+}
+
+static void exportTask(void *data, int index) {
+    ExportJobs *jobs = (ExportJobs *)data;
+    exportJob((*jobs->jobs)[(*jobs->indices)[index]]);
+}
+
+// Run export jobs on a pool of threads. The Interface_Static settings
+// are made before the workers start. Jobs meshing the shape run on the
+// calling thread after the workers have finished. Returns 1 if all jobs
+// succeeded.
+int OCCTools::exportMany(std::vector<OCCExportJob>& jobs, int threads = 0)
+{
+    configureStatic();
+    
+    std::vector<unsigned int> parallel, serial;
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        if (isMeshingFormat(jobs[i].format))
+            serial.push_back(i);
+        else
+            parallel.push_back(i);
+    }
+    
+    ExportJobs data;
+    data.jobs = &jobs;
+    data.indices = &parallel;
+    parallelFor(parallel.size(), exportTask, &data, threads);
+    
+    for (unsigned int i = 0; i < serial.size(); i++)
+        exportJob(jobs[serial[i]]);
+    
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        if (!jobs[i].status) {
+            setError("OCCTools::exportMany", "", "Failed to export one or more files");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Job for OCCTools::transformMany. Shared rigid transforms only move
+// the shape location, so the shapes are handed out in blocks to keep
+// the workers from contending on the job counter.
+static const size_t transformBlock = 64;
+
+struct TransformJob {
+    std::vector<OCCBase *> *shapes;
+    const double *matrices;
+    bool share;
+    std::vector<int> *status;
+    std::vector<OCCErrorInfo> *errors;
+};
+
+static void transformTask(void *data, int index) {
+    TransformJob *job = (TransformJob *)data;
+    const size_t start = index*transformBlock;
+    const size_t end = std::min(start + transformBlock, job->shapes->size());
+    bool failed = false;
+    for (size_t i = start; i < end; i++) {
+        OCCBase *shape = (*job->shapes)[i];
+        (*job->status)[i] = shape->transform(job->matrices + 12*i, shape, job->share);
+        // keep first error of the block
+        if (!(*job->status)[i] && !failed) {
+            (*job->errors)[index] = *getErrorInfo();
+            failed = true;
+        }
+    }
+}
+
+// Reason a 3x4 row major matrix can not be applied or NULL
+static const char *invalidMatrix(const double *mat)
+{
+    for (int k = 0; k < 12; k++) {
+        if (!(fabs(mat[k]) <= std::numeric_limits<double>::max()))
+            return "Matrix is not finite";
+    }
+    
+    gp_XYZ c0(mat[0], mat[4], mat[8]);
+    gp_XYZ c1(mat[1], mat[5], mat[9]);
+    gp_XYZ c2(mat[2], mat[6], mat[10]);
+    const double det = c0.Dot(c1 ^ c2);
+    if (fabs(det) <= 1e-12*c0.Modulus()*c1.Modulus()*c2.Modulus())
+        return "Matrix is singular";
+    return NULL;
+}
+
+static void setShapeError(size_t index, const char *operation,
+                          const char *type, const char *message)
+{
+    std::ostringstream msg;
+    msg << "Shape " << index << ": " << message;
+    setError(operation, type, msg.str().c_str());
+}
+
+// Apply n 3x4 row major matrices, stored contiguous, to the shapes in
+// place. The shapes and matrices are checked before any shape is moved.
+// Returns 1 if all shapes were transformed, otherwise the error names
+// the first shape which failed.
+int OCCTools::transformMany(std::vector<OCCBase *> shapes, const double *matrices,
+                            size_t n, int threads = 0, bool share = false)
+{
+    if (n != shapes.size()) {
+        setError("OCCTools::transformMany", "", "Number of matrices and shapes differ");
+        return 0;
+    }
+    
+    // a shape given twice would be moved twice, possibly by two
+    // threads at once
+    std::set<OCCBase *> seen;
+    for (size_t i = 0; i < n; i++) {
+        const char *reason = NULL;
+        if (!seen.insert(shapes[i]).second)
+            reason = "Shape given more than once";
+        else if (shapes[i]->isNull())
+            reason = "Null shape";
+        else
+            reason = invalidMatrix(matrices + 12*i);
+        if (reason != NULL) {
+            setShapeError(i, "OCCTools::transformMany", "", reason);
+            return 0;
+        }
+    }
+    
+    const size_t nblocks = (n + transformBlock - 1)/transformBlock;
+    std::vector<int> status(n, 0);
+    std::vector<OCCErrorInfo> errors(nblocks);
+    TransformJob job;
+    job.shapes = &shapes;
+    job.matrices = matrices;
+    job.share = share;
+    job.status = &status;
+    job.errors = &errors;
+    parallelFor(nblocks, transformTask, &job, threads);
+    
+    for (size_t i = 0; i < n; i++) {
+        if (!status[i]) {
+            const OCCErrorInfo& info = errors[i/transformBlock];
+            setShapeError(i, info.operation, info.type, info.message);
+            return 0;
+        }
+    }
+    return 1;
+}
\ No newline at end of file
@@ -3,6 +3,80 @@
 # This file is part of occmodel - See LICENSE.txt
 #
 
+cdef reportList(vector[c_OCCShapeReport] *creport):
+    '''
+    Convert import report to list of dictionaries.
+    '''
+    cdef c_OCCShapeReport entry
+    cdef size_t i
+    
+    res = []
+    for i in range(creport.size()):
+        entry = creport[0][i]
+        if entry.checked:
+            res.append({
+                'type': entry.type,
+                'index': entry.index,
+                'checked': True,
+                'valid': entry.valid,
+                'fixed': entry.fixed,
+                'checkTime': entry.checkTime,
+                'fixTime': entry.fixTime,
+            })
+        else:
+            # trusted mode, nothing known about validity
+            res.append({
+                'type': entry.type,
+                'index': entry.index,
+                'checked': False,
+                'valid': None,
+                'fixed': None,
+                'checkTime': None,
+                'fixTime': None,
+            })
+    return res
+    
+cdef wrapShape(c_OCCBase *cshape):
+    '''
+    Return Python object of matching type owning the shape.
+    '''
+    cdef Solid solid
+    cdef Face face
+    cdef Wire wire
+    cdef Edge edge
+    cdef Vertex vertex
+    
+    shapetype = cshape.shapeType()
+    
+    if shapetype == TopAbs_COMPSOLID or \
+       shapetype == TopAbs_SOLID:
+        solid = Solid.__new__(Solid, None)
+        solid.thisptr = cshape
+        return solid
+        
+    elif shapetype == TopAbs_SHELL or \
+         shapetype == TopAbs_FACE:
+        face = Face.__new__(Face, None)
+        face.thisptr = cshape
+        return face
+        
+    elif shapetype == TopAbs_WIRE:
+        wire = Wire.__new__(Wire, None)
+        wire.thisptr = cshape
+        return wire
+        
+    elif shapetype == TopAbs_EDGE:
+        edge = Edge.__new__(Edge, None)
+        edge.thisptr = cshape
+        return edge
+        
+    elif shapetype == TopAbs_VERTEX:
+        vertex = Vertex.__new__(Vertex, None)
+        vertex.thisptr = cshape
+        return vertex
+    
+    return None
+    
 cdef class Tools:
     '''
     Misc tools.
@@ -16,6 +90,7 @@ cdef class Tools:
         cdef vector[c_OCCBase *] cshapes
         cdef Base cobj
         cdef int ret
+        cdef char *cfilename
         
         if isinstance(shapes, Base):
             shapes = (shapes,)
@@ -23,9 +98,11 @@ cdef class Tools:
         for cobj in shapes:
             cshapes.push_back((<c_OCCBase *>cobj.thisptr))
         
-        ret = writeBREP(filename, cshapes)
+        cfilename = filename
+        with nogil:
+            ret = writeBREP(cfilename, cshapes)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return True
     
@@ -38,6 +115,7 @@ cdef class Tools:
         cdef vector[c_OCCBase *] cshapes
         cdef Base cobj
         cdef int ret
+        cdef char *cfilename
         
         if isinstance(shapes, Base):
             shapes = (shapes,)
@@ -45,9 +123,11 @@ cdef class Tools:
         for cobj in shapes:
             cshapes.push_back((<c_OCCBase *>cobj.thisptr))
         
-        ret = writeSTEP(filename, cshapes)
+        cfilename = filename
+        with nogil:
+            ret = writeSTEP(cfilename, cshapes)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return True
     
@@ -60,6 +140,7 @@ cdef class Tools:
         cdef vector[c_OCCBase *] cshapes
         cdef Base cobj
         cdef int ret
+        cdef char *cfilename
         
         if isinstance(shapes, Base):
             shapes = (shapes,)
@@ -67,9 +148,11 @@ cdef class Tools:
         for cobj in shapes:
             cshapes.push_back((<c_OCCBase *>cobj.thisptr))
         
-        ret = writeSTL(filename, cshapes)
+        cfilename = filename
+        with nogil:
+            ret = writeSTL(cfilename, cshapes)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return True
     
@@ -82,6 +165,7 @@ cdef class Tools:
         cdef vector[c_OCCBase *] cshapes
         cdef Base cobj
         cdef int ret
+        cdef char *cfilename
         
         if isinstance(shapes, Base):
             shapes = (shapes,)
@@ -89,30 +173,215 @@ cdef class Tools:
         for cobj in shapes:
             cshapes.push_back((<c_OCCBase *>cobj.thisptr))
         
-        ret = writeVRML(filename, cshapes)
+        cfilename = filename
+        with nogil:
+            ret = writeVRML(cfilename, cshapes)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return True
 
     @staticmethod
-    def readBREP(filename):
+    def exportMany(jobs, int threads = 0):
+        '''
+        Export shapes to files on a pool of threads.
+        
+        :param jobs: sequence of (shape, filename, format) tuples
+                     where format is EXPORT_BREP, EXPORT_BINARY,
+                     EXPORT_STEP, EXPORT_STL or EXPORT_VRML
+        :param threads: number of threads, 0 use all processors.
+                        STL and VRML jobs mesh the shape and are run
+                        on the calling thread after the other jobs.
+        
+        A list with one dictionary for each job holding the
+        'status', the 'time' in seconds and the error 'message'
+        is returned.
+        '''
+        cdef vector[c_OCCExportJob] cjobs
+        cdef c_OCCExportJob cjob
+        cdef Base shape
+        cdef size_t i
+        
+        # keep encoded filenames alive while running
+        filenames = []
+        for shape, filename, format in jobs:
+            if format not in (EXPORT_BREP, EXPORT_BINARY, EXPORT_STEP,
+                              EXPORT_STL, EXPORT_VRML):
+                raise OCCError('unknown export format')
+            shape.CheckPtr()
+            filenames.append(filename)
+            
+            cjob.shape = <c_OCCBase *>shape.thisptr
+            cjob.filename = filename
+            cjob.format = <c_ExportFormat>format
+            cjob.status = 0
+            cjob.time = 0.
+            cjobs.push_back(cjob)
+        
+        with nogil:
+            exportMany(cjobs, threads)
+        
+        res = []
+        for i in range(cjobs.size()):
+            res.append({
+                'status': bool(cjobs[i].status),
+                'time': cjobs[i].time,
+                'message': cjobs[i].message,
+            })
+        return res
+    
+    @staticmethod
+    def transformMany(shapes, matrices, int threads = 0, bint share = False):
+        '''
+        Transform shapes in place on a pool of threads.
+        
+        All shapes and matrices are checked before any shape is
+        moved. The error raised names the index of the first shape
+        which failed.
+        
+        :param shapes: sequence of distinct shapes
+        :param matrices: contiguous buffer of doubles with one row
+                         major 3x4 matrix for each shape, either with
+                         shape (N, 12) or flat with 12*N values
+        :param threads: number of threads, 0 use all processors
+        :param share: If True rigid matrices only change the shape
+                      locations and the geometry is not copied.
+        '''
+        cdef vector[c_OCCBase *] cshapes
+        cdef double[:, ::1] mat2d
+        cdef double[::1] mat1d
+        cdef double *cmat
+        cdef size_t n
+        cdef Base shape
+        cdef int ret
+        
+        for shape in shapes:
+            shape.CheckPtr()
+            cshapes.push_back(<c_OCCBase *>shape.thisptr)
+        
+        try:
+            mat2d = matrices
+        except ValueError:
+            mat1d = matrices
+            if mat1d.shape[0] % 12 != 0:
+                raise OCCError('expected 12 values for each matrix')
+            n = mat1d.shape[0] // 12
+            cmat = &mat1d[0] if n > 0 else NULL
+        else:
+            if mat2d.shape[1] != 12:
+                raise OCCError('expected 12 values for each matrix')
+            n = mat2d.shape[0]
+            cmat = &mat2d[0, 0] if n > 0 else NULL
+        
+        if n != cshapes.size():
+            raise OCCError('number of matrices and shapes differ')
+        
+        with nogil:
+            ret = transformMany(cshapes, cmat, n, threads, share)
+        
+        if not ret:
+            raise lastError()
+    
+    @staticmethod
+    def writeMeshSTL(filename, meshes):
+        '''
+        Write a sequence of meshes or a single mesh to a
+        binary STL file.
+        
+        The triangles of the meshes are written as is, without
+        meshing the shapes again.
+        '''
+        cdef vector[c_OCCMesh *] cmeshes
+        cdef Mesh mesh
+        cdef int ret
+        cdef char *cfilename
+        
+        if isinstance(meshes, Mesh):
+            meshes = (meshes,)
+        
+        for mesh in meshes:
+            cmeshes.push_back(<c_OCCMesh *>mesh.thisptr)
+        
+        cfilename = filename
+        with nogil:
+            ret = writeMeshSTL(cfilename, cmeshes)
+        if not ret:
+            raise lastError()
+            
+        return True
+    
+    @staticmethod
+    def writeMeshGLB(filename, meshes, bint quantize = False):
+        '''
+        Write a sequence of meshes or a single mesh to a
+        glTF binary (GLB) file with one node for each mesh.
+        
+        :param quantize: store positions as 16 bit and normals as
+                         8 bit integers (KHR_mesh_quantization)
+        '''
+        cdef vector[c_OCCMesh *] cmeshes
+        cdef Mesh mesh
+        cdef int ret
+        cdef char *cfilename
+        
+        if isinstance(meshes, Mesh):
+            meshes = (meshes,)
+        
+        for mesh in meshes:
+            cmeshes.push_back(<c_OCCMesh *>mesh.thisptr)
+        
+        cfilename = filename
+        with nogil:
+            ret = writeMeshGLB(cfilename, cmeshes, quantize)
+        if not ret:
+            raise lastError()
+            
+        return True
+    
+    @staticmethod
+    def removeShared(char *name):
+        '''
+        Remove named shared memory segment written by
+        Base.toShared.
+        '''
+        if not removeShared(name):
+            raise lastError()
+        
+        return True
+    
+    @staticmethod
+    def readBREP(filename, report = False):
         '''
         Read shapes from a BREP file.
         
+        Shapes are checked in parallel and healed if needed.
+        
+        :param report: if True a tuple of the shapes and a list
+                       with one dictionary for each imported shape
+                       is returned. The dictionary holds the 'type',
+                       the 'index' in the returned shapes (-1 if
+                       dropped), the 'valid' and 'fixed' flags and
+                       the 'checkTime' and 'fixTime' in seconds.
+                       In trusted mode 'checked' is False and the
+                       flags and times are None.
+        
         A sequence of shapes are returned.
         '''
         cdef vector[c_OCCBase *] cshapes
+        cdef vector[c_OCCShapeReport] creport
         cdef Solid solid
         cdef Face face
         cdef Wire wire
         cdef Edge edge
         cdef Vertex vertex
         cdef int i, ret
+        cdef char *cfilename
         
-        ret = readBREP(filename, cshapes)
+        cfilename = filename
+        with nogil:
+            ret = readBREP(cfilename, cshapes, &creport)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         if cshapes.size() == 0:
             raise OCCError('Failed to import objects')
@@ -147,27 +416,48 @@ cdef class Tools:
                 vertex = Vertex.__new__(Vertex, None)
                 vertex.thisptr = cshapes[i]
                 res.append(vertex)
-                
+        
+        if report:
+            return res, reportList(&creport)
         return res
     
     @staticmethod
-    def readSTEP(filename):
+    def readSTEP(filename, report = False, int threads = 1):
         '''
         Read shapes from a STEP file.
         
+        Shapes are checked in parallel and healed if needed.
+        
+        :param threads: number of threads the root transfers are
+                        partitioned between, 0 use all processors.
+                        The shapes are returned in root order. Files
+                        mixing units are transferred serially.
+        :param report: if True a tuple of the shapes and a list
+                       with one dictionary for each imported shape
+                       is returned. The dictionary holds the 'type',
+                       the 'index' in the returned shapes (-1 if
+                       dropped), the 'valid' and 'fixed' flags and
+                       the 'checkTime' and 'fixTime' in seconds.
+                       In trusted mode 'checked' is False and the
+                       flags and times are None.
+        
         A sequence of shapes are returned.
         '''
         cdef vector[c_OCCBase *] cshapes
+        cdef vector[c_OCCShapeReport] creport
         cdef Solid solid
         cdef Face face
         cdef Wire wire
         cdef Edge edge
         cdef Vertex vertex
         cdef int i, ret
+        cdef char *cfilename
         
-        ret = readSTEP(filename, cshapes)
+        cfilename = filename
+        with nogil:
+            ret = readSTEP(cfilename, cshapes, &creport, threads)
         if not ret or cshapes.size() == 0:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         res = []
         for i in range(cshapes.size()):
@@ -199,5 +489,68 @@ cdef class Tools:
                 vertex = Vertex.__new__(Vertex, None)
                 vertex.thisptr = cshapes[i]
                 res.append(vertex)
-                
-        return res
\ No newline at end of file
+        
+        if report:
+            return res, reportList(&creport)
+        return res
+
+cdef class StepReader:
+    '''
+    Read shapes from a STEP file one root at a time.
+    
+    The transfer data of each root is released before the
+    shapes are returned, which keeps memory bounded when
+    processing large assemblies::
+        
+        for shape in StepReader('model.stp'):
+            ...
+    '''
+    cdef c_OCCStepReader *thisptr
+    
+    def __init__(self, filename):
+        cdef char *cfilename = filename
+        cdef int ret
+        
+        self.thisptr = new c_OCCStepReader()
+        with nogil:
+            ret = self.thisptr.open(cfilename)
+        if not ret:
+            raise lastError()
+        
+    def __dealloc__(self):
+        if self.thisptr != NULL:
+            del self.thisptr
+            
+    def __str__(self):
+        return 'StepReader%s' % self.__repr__()
+    
+    def __repr__(self):
+        self.CheckPtr()
+        return '(nroots = %d)' % self.thisptr.numRoots()
+    
+    def __iter__(self):
+        return self
+        
+    cdef CheckPtr(self):
+        if self.thisptr == NULL:
+            raise TypeError('StepReader object not initialized')
+    
+    def __next__(self):
+        cdef c_OCCBase *nxt
+        
+        self.CheckPtr()
+        with nogil:
+            nxt = self.thisptr.next()
+        if nxt == NULL:
+            if self.thisptr.hasFailed():
+                raise lastError()
+            raise StopIteration()
+        
+        return wrapShape(nxt)
+    
+    cpdef int numRoots(self):
+        '''
+        Return number of roots in file
+        '''
+        self.CheckPtr()
+        return self.thisptr.numRoots()
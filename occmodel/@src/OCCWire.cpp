@@ -14,13 +14,7 @@ OCCWire *OCCWire::copy(bool deepCopy = false)
             ret->setShape(this->getShape());
         }
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to copy wire");
-        }
+        setFailure("OCCWire::copy", "Failed to copy wire");
         return NULL;
     }
     return ret;
@@ -85,13 +79,7 @@ int OCCWire::createWire(std::vector<OCCEdge *> edges)
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to create wire");
-        }
+        setFailure("OCCWire::createWire", "Failed to create wire");
         return 0;
     }
     return 1;
@@ -125,13 +113,7 @@ int OCCWire::project(OCCBase *face) {
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to project wire");
-        }
+        setFailure("OCCWire::project", "Failed to project wire");
         return 0;
     }
     return 1;
@@ -171,13 +153,7 @@ int OCCWire::offset(double distance, int joinType = 0) {
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to offset wire");
-        }
+        setFailure("OCCWire::offset", "Failed to offset wire");
         return 0;
     }
     return 1;
@@ -234,13 +210,7 @@ int OCCWire::fillet(std::vector<OCCVertex *> vertices, std::vector<double> radiu
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to fillet wire");
-        }
+        setFailure("OCCWire::fillet", "Failed to fillet wire");
         return 0;
     }
     return 1;
@@ -360,13 +330,7 @@ int OCCWire::chamfer(std::vector<OCCVertex *> vertices, std::vector<double> dist
             StdFail_NotDone::Raise("Shapes not valid");
         
     } catch(Standard_Failure &err) {
-        Handle_Standard_Failure e = Standard_Failure::Caught();
-        const Standard_CString msg = e->GetMessageString();
-        if (msg != NULL && strlen(msg) > 1) {
-            setErrorMessage(msg);
-        } else {
-            setErrorMessage("Failed to chamfer wire");
-        }
+        setFailure("OCCWire::chamfer", "Failed to chamfer wire");
         return 0;
     }
     return 1;
@@ -385,10 +349,10 @@ OCCTesselation *OCCWire::tesselate(double angular, double curvature)
         
         for (exWire.Init(this->getWire()); exWire.More(); exWire.Next()) {
             const TopoDS_Edge& edge = exWire.Current();
-            TopLoc_Location loc = edge.Location();
+            // curve without location, which is applied to the points
+            TopLoc_Location loc;
+            const Handle(Geom_Curve)& curve = BRep_Tool::Curve(edge, loc, start, end);
             gp_Trsf location = loc.Transformation();
-            
-            const Handle(Geom_Curve)& curve = BRep_Tool::Curve(edge, start, end);
             const GeomAdaptor_Curve& aCurve(curve);
             
             GCPnts_TangentialDeflection TD(aCurve, start, end, angular, curvature);
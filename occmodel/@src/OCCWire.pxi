@@ -112,7 +112,7 @@ cdef class Wire(Base):
         
         ret = occ.createWire(cedges)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -125,7 +125,7 @@ cdef class Wire(Base):
         cdef Tesselation ret = Tesselation.__new__(Tesselation, None)
         
         if tess == NULL:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         ret.thisptr = tess
         ret.setArrays()
@@ -339,7 +339,7 @@ cdef class Wire(Base):
         
         ret = occ.project(<c_OCCBase *>face.thisptr)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
         
@@ -352,7 +352,7 @@ cdef class Wire(Base):
         
         ret = occ.offset(distance, joinType)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
             
         return self
     
@@ -388,7 +388,7 @@ cdef class Wire(Base):
         
         ret = occ.fillet(cvertices, cradius)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         return self
     
@@ -424,7 +424,7 @@ cdef class Wire(Base):
         
         ret = occ.chamfer(cvertices, cdistance)
         if not ret:
-            raise OCCError(errorMessage)
+            raise lastError()
         
         return self
     
@@ -0,0 +1,175 @@
+#!/usr/bin/python2
+# -*- coding: utf-8 -*-
+#
+# This file is part of occmodel - See LICENSE.txt
+#
+# Timing of slow operations. Run all benchmarks or the ones
+# given by name on the command line.
+#
+import os
+import sys
+import pickle
+import tempfile
+import time
+
+from occmodel import Solid, Tools, OCCError
+from occmodel import setNormalKernel, NORMALS_AUTO, NORMALS_SCALAR
+from occmodel import NORMALS_SSE, NORMALS_AVX2
+
+def timeit(func, *args, **kwargs):
+    start = time.time()
+    ret = func(*args, **kwargs)
+    return time.time() - start, ret
+
+def bench_optimize():
+    '''
+    Vertex cache optimisation of a mesh with about 10^6 triangles
+    '''
+    solid = Solid().createSphere((0.,0.,0.), 1.)
+    mesh = solid.createMesh(factor = .0001, angle = .01)
+
+    dt, ret = timeit(mesh.optimize)
+    print('optimize: %d triangles in %.3f s' % (mesh.ntriangles(), dt))
+
+def bench_normals():
+    '''
+    Mesh normals of a sphere with about 10^6 triangles calculated
+    with each kernel. The first mesh leaves the triangulation on the
+    shape, so the timings are dominated by the mesh extraction.
+    '''
+    solid = Solid().createSphere((0.,0.,0.), 1.)
+    mesh = solid.createMesh(factor = .0001, angle = .01)
+
+    kernels = (
+        ('scalar', NORMALS_SCALAR),
+        ('sse', NORMALS_SSE),
+        ('avx2', NORMALS_AVX2),
+        ('auto', NORMALS_AUTO),
+    )
+    try:
+        for name, kernel in kernels:
+            try:
+                setNormalKernel(kernel)
+            except OCCError:
+                print('normals: %s not supported' % name)
+                continue
+            dt, mesh = timeit(solid.createMesh, factor = .0001, angle = .01)
+            print('normals: %d triangles, %s %.3f s' % (mesh.ntriangles(), name, dt))
+    finally:
+        setNormalKernel(NORMALS_AUTO)
+
+def perforatedPlate(n):
+    plate = Solid().createBox((0.,0.,0.),(n,n,1.))
+    holes = []
+    for i in range(n):
+        for j in range(n):
+            x, y = i + .5, j + .5
+            holes.append(Solid().createCylinder((x,y,-1.),(x,y,2.),.25))
+    return plate, holes
+
+def bench_perforated(n = 45):
+    '''
+    Plate with n x n disjoint holes cut with a compound tool in one
+    boolean, with the tools as sequence and with the independent
+    holes cut from slabs of the plate in parallel.
+    '''
+    plate, holes = perforatedPlate(n)
+    dt, ret = timeit(plate.cut, Solid().addSolids(holes))
+    print('perforated: %d holes, compound tool %.2f s' % (n*n, dt))
+
+    plate, holes = perforatedPlate(n)
+    dt, ret = timeit(plate.cut, holes)
+    print('perforated: %d holes, tool sequence %.2f s' % (n*n, dt))
+
+    plate, holes = perforatedPlate(n)
+    dt, ret = timeit(plate.cut, holes, slabs = True)
+    print('perforated: %d holes, slabs %.2f s' % (n*n, dt))
+
+def bench_serialize(n = 20):
+    '''
+    Size and round trip time of a plate with n x n holes serialized
+    in the BREP text format, the binary format and the compressed
+    binary format, and pickled.
+    '''
+    plate, holes = perforatedPlate(n)
+    plate.cut(holes)
+
+    formats = (
+        ('text', False, False),
+        ('binary', True, False),
+        ('compressed', True, True),
+    )
+    for name, binary, compress in formats:
+        dt1, data = timeit(plate.toString, binary = binary, compress = compress)
+        dt2, ret = timeit(Solid().fromString, data)
+        print('serialize: %s %d bytes, write %.3f s, read %.3f s' %
+              (name, len(data), dt1, dt2))
+
+    dt1, data = timeit(pickle.dumps, plate, pickle.HIGHEST_PROTOCOL)
+    dt2, ret = timeit(pickle.loads, data)
+    print('serialize: pickle %d bytes, dump %.3f s, load %.3f s' %
+          (len(data), dt1, dt2))
+
+def bench_readSTEP(n = 400):
+    '''
+    STEP file with n roots read with one thread and with the root
+    transfers partitioned between all processors.
+    '''
+    solids = []
+    for i in range(n):
+        x = 3.*i
+        solid = Solid().createBox((x,0.,0.),(x + 2.,2.,2.))
+        solid.fillet(.2)
+        solids.append(solid)
+    
+    fd, filename = tempfile.mkstemp(suffix = '.stp')
+    os.close(fd)
+    try:
+        Tools.writeSTEP(filename, solids)
+        dt, ret = timeit(Tools.readSTEP, filename, threads = 1)
+        print('readSTEP: %d roots, 1 thread %.2f s' % (n, dt))
+        dt, ret = timeit(Tools.readSTEP, filename, threads = 0)
+        print('readSTEP: %d roots, all threads %.2f s' % (n, dt))
+    finally:
+        os.remove(filename)
+
+def bench_export():
+    '''
+    Export of a sphere with about 10^6 triangles with the shape
+    writers, which mesh the shape again, and with the mesh writers.
+    '''
+    solid = Solid().createSphere((0.,0.,0.), 1.)
+    mesh = solid.createMesh(factor = .0001, angle = .01)
+
+    writers = (
+        ('writeSTL', Tools.writeSTL, solid, {}),
+        ('writeVRML', Tools.writeVRML, solid, {}),
+        ('writeMeshSTL', Tools.writeMeshSTL, mesh, {}),
+        ('writeMeshGLB', Tools.writeMeshGLB, mesh, {}),
+        ('writeMeshGLB quantized', Tools.writeMeshGLB, mesh, {'quantize': True}),
+    )
+    fd, filename = tempfile.mkstemp()
+    os.close(fd)
+    try:
+        for name, func, arg, kwargs in writers:
+            dt, ret = timeit(func, filename, arg, **kwargs)
+            size = os.path.getsize(filename)
+            print('export: %s %d bytes in %.3f s, %.1f MB/s' %
+                  (name, size, dt, size / dt / 1e6))
+    finally:
+        os.remove(filename)
+
+BENCHMARKS = (
+    ('optimize', bench_optimize),
+    ('normals', bench_normals),
+    ('perforated', bench_perforated),
+    ('serialize', bench_serialize),
+    ('readSTEP', bench_readSTEP),
+    ('export', bench_export),
+)
+
+if __name__ == '__main__':
+    names = sys.argv[1:]
+    for name, func in BENCHMARKS:
+        if not names or name in names:
+            func()
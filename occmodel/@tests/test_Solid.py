@@ -3,12 +3,29 @@
 #
 # This file is part of occmodel - See LICENSE.txt
 #
+import os
 import sys
+import json
+import struct
+import pickle
+import tempfile
 import unittest
 
 from math import pi, sin, cos, sqrt
 
-from occmodel import Vertex, Edge, Face, Solid, OCCError
+from geotools import Transform
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+from occmodel import Vertex, Edge, Face, Solid, Assembly, Tools, StepReader, OCCError
+from occmodel import setNormalKernel, NORMALS_AUTO, NORMALS_SCALAR
+from occmodel import setMeshCacheBudget, clearMeshCache, getMeshCacheInfo
+from occmodel import setTrusted, isTrusted
+from occmodel import EXPORT_BREP, EXPORT_BINARY, EXPORT_STEP
+from occmodel import EXPORT_STL, EXPORT_VRML
 
 class test_Solid(unittest.TestCase):
     def almostEqual(self, a, b, places = 7):
@@ -39,6 +56,88 @@ class test_Solid(unittest.TestCase):
         solid.rotate(-pi/2., (0.,1.,0.),(1.,1.,0.))
         eq(solid.centreOfMass(), (1.,0.,-1.))
     
+    def test_moveLocation(self):
+        eq = self.almostEqual
+        aeq = self.assertAlmostEqual
+        
+        s1 = Solid().createBox((0.,0.,0.),(1.,2.,3.))
+        s1.fuse(Solid().createSphere((1.,2.,3.),.5))
+        m1 = s1.createMesh()
+        
+        s2 = s1.rotate(pi/3., (0.,0.,1.), (1.,1.,0.), copy = True, share = True)
+        s2.translate((5.,0.,0.), share = True)
+        s3 = s1.transform(Transform().translate(0.,5.,0.), copy = True, share = True)
+        
+        # shared rigid moves keep the geometry of s1
+        asm = Assembly().addShape(Solid().addSolids([s1, s2, s3]))
+        self.assertEqual(asm.nprototypes(), 1)
+        
+        # by default the geometry is copied
+        s5 = s1.translate((0.,0.,5.), copy = True)
+        aeq(s5.volume(), s1.volume())
+        asm = Assembly().addShape(Solid().addSolids([s1, s5]))
+        self.assertEqual(asm.nprototypes(), 2)
+        
+        for solid in (s2, s3):
+            aeq(solid.volume(), s1.volume())
+            aeq(solid.area(), s1.area())
+            
+            m2 = solid.createMesh()
+            self.assertEqual(m2.nvertices(), m1.nvertices())
+            self.assertEqual(m2.ntriangles(), m1.ntriangles())
+        
+        # the mesh is moved with the shape
+        s2.translate((-5.,0.,0.), share = True)
+        m3 = s2.rotate(-pi/3., (0.,0.,1.), (1.,1.,0.), share = True).createMesh()
+        for i in range(m1.nvertices()):
+            eq(m3.vertex(i), m1.vertex(i), places = 5)
+            eq(m3.normal(i), m1.normal(i), places = 5)
+        
+        # scaling copies the geometry
+        s4 = s1.scale((0.,0.,0.), 2., copy = True)
+        aeq(s4.volume(), 8.*s1.volume(), places = 3)
+        asm = Assembly().addShape(Solid().addSolids([s1, s4]))
+        self.assertEqual(asm.nprototypes(), 2)
+    
+    @unittest.skipIf(numpy is None, 'requires numpy')
+    def test_transformMany(self):
+        eq = self.almostEqual
+        
+        n = 1000
+        solids = [Solid().createBox((0.,0.,0.),(1.,1.,1.)) for i in range(n)]
+        ref = [solid.translate((i,0.,0.), copy = True) for i, solid in enumerate(solids)]
+        
+        matrices = numpy.zeros((n, 12))
+        matrices[:,0] = matrices[:,5] = matrices[:,10] = 1.
+        matrices[:,3] = numpy.arange(n)
+        Tools.transformMany(solids, matrices)
+        
+        for solid, other in zip(solids, ref):
+            eq(solid.centreOfMass(), other.centreOfMass())
+        
+        # flat buffer
+        matrices[:,3] = -matrices[:,3]
+        Tools.transformMany(solids, matrices.ravel(), threads = 2)
+        for solid in solids[::100]:
+            eq(solid.centreOfMass(), (.5,.5,.5))
+        
+        self.assertRaises(OCCError, Tools.transformMany, solids[:2], matrices)
+        self.assertRaises(OCCError, Tools.transformMany, solids[:2], numpy.zeros((2, 6)))
+        self.assertRaises(OCCError, Tools.transformMany, solids[:1]*2, matrices[:2])
+        
+        # singular matrix, no shape is moved
+        bad = numpy.zeros((3, 12))
+        bad[:,0] = bad[:,5] = bad[:,10] = 1.
+        bad[2,:] = 0.
+        try:
+            Tools.transformMany(solids[:3], bad)
+        except OCCError as err:
+            self.assertTrue('Shape 2' in str(err))
+        else:
+            self.fail('expected OCCError')
+        for solid in solids[:3]:
+            eq(solid.centreOfMass(), (.5,.5,.5))
+    
     def test_scale(self):
         eq = self.assertAlmostEqual
         
@@ -70,6 +169,106 @@ class test_Solid(unittest.TestCase):
         s1.addSolids(s3)
         self.assertEqual(s1.numSolids(), 3)
     
+    def test_createMesh(self):
+        eq = self.assertEqual
+        
+        solid = Solid().createBox((-.5,-.5,-.5),(.5,.5,.5))
+        solid.fuse(Solid().createSphere((.5,.5,.5),.25))
+        
+        m1 = solid.createMesh()
+        m2 = solid.createMesh(parallel = True)
+        
+        eq(m2.isValid(), True)
+        eq(m1.nvertices(), m2.nvertices())
+        eq(m1.ntriangles(), m2.ntriangles())
+        eq(m1.nedgeIndices(), m2.nedgeIndices())
+    
+    def test_meshNormals(self):
+        eq = self.assertAlmostEqual
+        
+        solid = Solid().createBox((-.5,-.5,-.5),(.5,.5,.5))
+        
+        setNormalKernel(NORMALS_SCALAR)
+        m1 = solid.createMesh()
+        setNormalKernel(NORMALS_AUTO)
+        m2 = solid.createMesh()
+        
+        for i in range(m1.nnormals()):
+            n1, n2 = m1.normal(i), m2.normal(i)
+            eq(sqrt(sum(v*v for v in n1)), 1., places = 5)
+            for j in range(3):
+                eq(n1[j], n2[j], places = 5)
+            
+            # normals point out of the box
+            v = m1.vertex(i)
+            self.assertTrue(sum(v[j]*n1[j] for j in range(3)) > 0.)
+        
+        # small box far from the origin keeps its triangles and normals
+        d = 1e5
+        far = Solid().createBox((d-.005,d-.005,d-.005),(d+.005,d+.005,d+.005))
+        m3 = far.createMesh()
+        self.assertEqual(m3.ntriangles(), m1.ntriangles())
+        for i in range(m3.nnormals()):
+            n3 = m3.normal(i)
+            eq(sqrt(sum(v*v for v in n3)), 1., places = 5)
+        
+    def test_meshCache(self):
+        eq = self.assertEqual
+        
+        setMeshCacheBudget(64*1024*1024)
+        clearMeshCache()
+        try:
+            solid = Solid().createBox((-.5,-.5,-.5),(.5,.5,.5))
+            m1 = solid.createMesh()
+            m2 = solid.createMesh()
+            m3 = solid.createMesh(factor = .005)
+            
+            info = getMeshCacheInfo()
+            eq(info['hits'], 1)
+            eq(info['misses'], 2)
+            eq(info['count'], 2)
+            eq(m1.nvertices(), m2.nvertices())
+            eq(m1.ntriangles(), m2.ntriangles())
+            
+            # changed shape is not found in cache
+            solid.translate((1.,0.,0.))
+            solid.createMesh()
+            eq(getMeshCacheInfo()['misses'], 3)
+        finally:
+            setMeshCacheBudget(0)
+        
+        eq(getMeshCacheInfo()['count'], 0)
+        
+    def test_incrementalMesh(self):
+        eq = self.assertEqual
+        
+        s1 = Solid().createBox((-.5,-.5,-.5),(.5,.5,.5))
+        s2 = Solid().createBox((-.5,-.5,-.5),(.5,.5,.5))
+        
+        # only s1 keeps triangulation of the faces untouched by cut
+        s1.createMesh()
+        for solid in (s1, s2):
+            solid.cut(Solid().createCylinder((0.,0.,-1.),(0.,0.,1.),.2))
+        
+        m1 = s1.createMesh()
+        m2 = s2.createMesh()
+        eq(m1.nvertices(), m2.nvertices())
+        eq(m1.ntriangles(), m2.ntriangles())
+        eq(m1.nedgeIndices(), m2.nedgeIndices())
+        
+    def test_qualityNormals(self):
+        eq = self.assertAlmostEqual
+        
+        solid = Solid().createSphere((0.,0.,0.),1.)
+        mesh = solid.createMesh(qualityNormals = True)
+        
+        # sphere normals are radial
+        for i in range(mesh.nnormals()):
+            v, n = mesh.vertex(i), mesh.normal(i)
+            r = sqrt(sum(c*c for c in v))
+            for j in range(3):
+                eq(n[j], v[j]/r, places = 4)
+        
     def test_createSphere(self):
         eq = self.assertAlmostEqual
         
@@ -82,6 +281,18 @@ class test_Solid(unittest.TestCase):
         eq(solid.area(), 4.*pi, places = 3)
         eq(solid.volume(), 4./3.*pi, places = 3)
         
+    def test_error(self):
+        eq = self.assertEqual
+        
+        try:
+            Solid().createSphere((0.,0.,0.),0.)
+        except OCCError as err:
+            eq(str(err), 'radius to small')
+            eq(err.operation, 'OCCSolid::createSphere')
+            eq(err.type, 'StdFail_NotDone')
+        else:
+            self.fail('OCCError not raised')
+        
     def test_createCylinder(self):
         eq = self.assertAlmostEqual
         
@@ -126,6 +337,359 @@ class test_Solid(unittest.TestCase):
         solid.createBox((-.5,-.5,-.5),(.5,.5,.5))
         
         eq(solid.volume(), 1.)
+    
+    def test_booleanMany(self):
+        eq = self.assertAlmostEqual
+        
+        # plate drilled with a grid of holes in one pass
+        plate = Solid().createBox((0.,0.,0.),(10.,10.,1.))
+        r = .25
+        holes = []
+        for i in range(5):
+            for j in range(5):
+                x, y = 1. + 2.*i, 1. + 2.*j
+                holes.append(Solid().createCylinder((x,y,-1.),(x,y,2.),r))
+        
+        plate.cut(holes)
+        eq(plate.volume(), 100. - 25*pi*r*r, places = 3)
+        
+        # overlapping tools are fused together
+        solid = Solid().createBox((0.,0.,0.),(1.,1.,1.))
+        solid.fuse([Solid().createBox((.5,0.,0.),(1.5,1.,1.)),
+                    Solid().createBox((1.,0.,0.),(2.,1.,1.))])
+        eq(solid.volume(), 2., places = 6)
+    
+    def test_trusted(self):
+        eq = self.assertEqual
+        
+        eq(isTrusted(), False)
+        setTrusted(True)
+        try:
+            solid = Solid().createBox((-.5,-.5,-.5),(.5,.5,.5))
+            solid.cut(Solid().createCylinder((0.,0.,-1.),(0.,0.,1.),.2))
+        finally:
+            setTrusted(False)
+        
+        # validate once at the end
+        eq(solid.isValid(), True)
+        self.assertAlmostEqual(solid.volume(), 1. - pi*.2*.2, places = 6)
+        
+    def test_fuseAll(self):
+        eq = self.assertAlmostEqual
+        
+        # chain of boxes overlapping half way, given out of order
+        solids = []
+        for i in (3, 0, 6, 1, 5, 2, 4):
+            solids.append(Solid().createBox((.5*i,0.,0.),(.5*i + 1.,1.,1.)))
+        
+        solid = Solid().fuseAll(solids)
+        eq(solid.volume(), 4., places = 6)
+        
+        solid = Solid().fuseAll(solids, sort = False)
+        eq(solid.volume(), 4., places = 6)
+        
+        # overlapping instances sharing the geometry of one box
+        box = Solid().createBox((0.,0.,0.),(1.,1.,1.))
+        solids = [box.translate((.5*i,0.,0.), copy = True, share = True)
+                  for i in range(1, 8)]
+        solid = Solid().fuseAll(solids)
+        eq(solid.volume(), 4., places = 6)
+        eq(solid.isValid(), True)
+        eq(box.volume(), 1., places = 6)
+        
+    def test_booleanClusters(self):
+        eq = self.assertAlmostEqual
+        
+        # slots made of two overlapping boxes and tools far away
+        # from the plate given as compound tool.
+        plate = Solid().createBox((0.,0.,0.),(10.,10.,1.))
+        tools = []
+        for i in range(4):
+            for j in range(4):
+                x, y = 1. + 2.*i, 1. + 2.*j
+                tools.append(Solid().createBox((x,y,-1.),(x + 1.,y + .5,2.)))
+                tools.append(Solid().createBox((x + .5,y,-1.),(x + 1.5,y + .5,2.)))
+        tools.append(Solid().createBox((20.,20.,20.),(21.,21.,21.)))
+        
+        plate.cut([Solid().addSolids(tools)])
+        eq(plate.volume(), 100. - 16*.75, places = 6)
+        eq(plate.area(), 2.*(100. - 16*.75) + 40. + 16*4., places = 6)
+        self.assertEqual(plate.numFaces(), 6 + 16*4)
+        
+        # faces split between slabs cut in parallel are merged again
+        plate = Solid().createBox((0.,0.,0.),(10.,10.,1.))
+        plate.cut([Solid().addSolids(tools)], slabs = True)
+        eq(plate.volume(), 100. - 16*.75, places = 6)
+        self.assertEqual(plate.numSolids(), 1)
+        self.assertEqual(plate.numFaces(), 6 + 16*4)
+        self.assertEqual(plate.isValid(), True)
+        
+        # tools outside only leaves solid unchanged
+        plate = Solid().createBox((0.,0.,0.),(10.,10.,1.))
+        plate.cut([Solid().createBox((20.,20.,20.),(21.,21.,21.)),
+                   Solid().createBox((30.,20.,20.),(31.,21.,21.))])
+        eq(plate.volume(), 100., places = 6)
+        
+    def test_serialize(self):
+        eq = self.assertAlmostEqual
+        
+        solid = Solid().createBox((-.5,-.5,-.5),(.5,.5,.5))
+        solid.cut(Solid().createSphere((.5,.5,.5),.25))
+        
+        text = solid.toString()
+        data = solid.toString(binary = True)
+        packed = solid.toString(binary = True, compress = True)
+        self.assertTrue(len(packed) < len(data) < len(text))
+        
+        for st in (text, data, packed):
+            eq(Solid().fromString(st).volume(), solid.volume(), places = 6)
+        
+        copy = pickle.loads(pickle.dumps(solid))
+        self.assertTrue(isinstance(copy, Solid))
+        eq(copy.volume(), solid.volume(), places = 6)
+        
+        self.assertRaises(OCCError, Solid().fromString, packed[:-10])
+        
+    def test_shared(self):
+        eq = self.assertAlmostEqual
+        
+        solid = Solid().createBox((-.5,-.5,-.5),(.5,.5,.5))
+        solid.cut(Solid().createSphere((.5,.5,.5),.25))
+        
+        name = 'occmodel-test-%d' % os.getpid()
+        for compress in (False, True):
+            solid.toShared(name, compress)
+            try:
+                copy = Solid().fromShared(name)
+            finally:
+                Tools.removeShared(name)
+            eq(copy.volume(), solid.volume(), places = 6)
+        
+        self.assertRaises(OCCError, Solid().fromShared, name)
+        
+    def test_writeMesh(self):
+        eq = self.assertEqual
+        
+        solid = Solid().createBox((-.5,-.5,-.5),(.5,.5,.5))
+        mesh = solid.createMesh()
+        
+        fd, filename = tempfile.mkstemp(suffix = '.stl')
+        os.close(fd)
+        try:
+            Tools.writeMeshSTL(filename, mesh)
+            eq(os.path.getsize(filename), 84 + 50*mesh.ntriangles())
+            
+            Tools.writeMeshGLB(filename, [mesh, mesh])
+            size = os.path.getsize(filename)
+            with open(filename, 'rb') as fh:
+                eq(fh.read(4), b'glTF')
+            
+            Tools.writeMeshGLB(filename, mesh, quantize = True)
+            self.assertTrue(os.path.getsize(filename) < size)
+            
+            with open(filename, 'rb') as fh:
+                data = fh.read()
+        finally:
+            os.remove(filename)
+        
+        # header, JSON chunk and BIN chunk
+        magic, version, total = struct.unpack_from('<4sII', data, 0)
+        eq(version, 2)
+        eq(total, len(data))
+        jsonSize, = struct.unpack_from('<I', data, 12)
+        gltf = json.loads(data[20:20 + jsonSize].decode('utf-8'))
+        binary = data[20 + jsonSize + 8:]
+        
+        position, normal, indices = gltf['accessors']
+        eq(position['count'], mesh.nvertices())
+        eq(normal['count'], mesh.nvertices())
+        eq(indices['count'], 3*mesh.ntriangles())
+        
+        # accessor bounds match the stored positions
+        view = gltf['bufferViews'][position['bufferView']]
+        values = [struct.unpack_from('<3h', binary, view['byteOffset'] + 8*i)
+                  for i in range(position['count'])]
+        for k in range(3):
+            eq(position['min'][k], min(v[k] for v in values))
+            eq(position['max'][k], max(v[k] for v in values))
+        
+    def test_exportMany(self):
+        eq = self.assertEqual
+        
+        solids = [Solid().createBox((2.*i,0.,0.),(2.*i + 1.,1.,1.))
+                  for i in range(3)]
+        formats = (EXPORT_BREP, EXPORT_BINARY, EXPORT_STEP)
+        
+        tmpdir = tempfile.mkdtemp()
+        try:
+            jobs = []
+            for solid, format in zip(solids, formats):
+                filename = os.path.join(tmpdir, 'part%d' % format)
+                jobs.append((solid, filename, format))
+            jobs.append((solids[0], os.path.join(tmpdir, 'none', 'part'), EXPORT_BREP))
+            
+            # meshing formats sharing shapes with the other jobs
+            jobs.append((solids[0], os.path.join(tmpdir, 'part.stl'), EXPORT_STL))
+            jobs.append((solids[0], os.path.join(tmpdir, 'part.wrl'), EXPORT_VRML))
+            jobs.append((solids[1], os.path.join(tmpdir, 'part1.stl'), EXPORT_STL))
+            
+            res = Tools.exportMany(jobs, threads = 2)
+            eq([entry['status'] for entry in res],
+               [True, True, True, False, True, True, True])
+            self.assertTrue(res[3]['message'])
+            
+            for solid, filename, format in jobs[4:]:
+                self.assertTrue(os.path.getsize(filename) > 0)
+            with open(jobs[5][1], 'rb') as fh:
+                eq(fh.read(5), b'#VRML')
+            
+            for solid, filename, format in jobs[:2]:
+                shape = Tools.readBREP(filename)[0]
+                self.assertAlmostEqual(shape.volume(), 1., places = 6)
+            eq(len(Tools.readSTEP(jobs[2][1])), 1)
+        finally:
+            for name in os.listdir(tmpdir):
+                os.remove(os.path.join(tmpdir, name))
+            os.rmdir(tmpdir)
+        
+    def test_assembly(self):
+        eq = self.assertEqual
+        
+        # one bolt placed many times
+        bolt = Solid().createCylinder((0.,0.,0.),(0.,0.,2.),.25)
+        asm = Assembly().addShape(bolt)
+        for i in range(1, 10):
+            asm.addInstance(0, Transform().translate(i,0.,0.))
+        eq(asm.nprototypes(), 1)
+        eq(asm.ninstances(), 10)
+        
+        # locations must be rigid
+        self.assertRaises(OCCError, asm.addInstance, 0,
+                          Transform().scale(2.,2.,2.))
+        eq(asm.ninstances(), 10)
+        
+        prototype, mat = asm.instance(3)
+        eq(prototype, 0)
+        self.assertAlmostEqual(mat.m[0][3], 3.)
+        
+        mesh = asm.createMesh(0)
+        eq(mesh.isValid(), True)
+        
+        for ext in ('.brep', '.stp'):
+            fd, filename = tempfile.mkstemp(suffix = ext)
+            os.close(fd)
+            try:
+                if ext == '.brep':
+                    asm.writeBREP(filename)
+                    copy = Assembly().readBREP(filename)
+                else:
+                    asm.writeSTEP(filename)
+                    copy = Assembly().readSTEP(filename)
+            finally:
+                os.remove(filename)
+            
+            eq(copy.nprototypes(), 1)
+            eq(copy.ninstances(), 10)
+            self.assertAlmostEqual(copy.prototype(0).volume(), bolt.volume(), places = 6)
+        
+    def test_readBREP(self):
+        eq = self.assertAlmostEqual
+        
+        solid = Solid().createBox((-.5,-.5,-.5),(.5,.5,.5))
+        solid.cut(Solid().createSphere((.5,.5,.5),.25))
+        
+        fd, filename = tempfile.mkstemp(suffix = '.brep')
+        os.close(fd)
+        try:
+            Tools.writeBREP(filename, solid)
+            shapes = Tools.readBREP(filename)
+            eq(shapes[0].volume(), solid.volume(), places = 6)
+            
+            # binary data is detected
+            with open(filename, 'wb') as fh:
+                fh.write(solid.toString(binary = True, compress = True))
+            shapes = Tools.readBREP(filename)
+            eq(shapes[0].volume(), solid.volume(), places = 6)
+        finally:
+            os.remove(filename)
+        
+    def test_readReport(self):
+        eq = self.assertEqual
+        
+        solids = [Solid().createBox((2.*i,0.,0.),(2.*i + 1.,1.,1.))
+                  for i in range(4)]
+        
+        fd, filename = tempfile.mkstemp(suffix = '.stp')
+        os.close(fd)
+        try:
+            Tools.writeSTEP(filename, solids)
+            shapes, report = Tools.readSTEP(filename, report = True)
+            threaded = Tools.readSTEP(filename, threads = 2)
+        finally:
+            os.remove(filename)
+        
+        eq(len(threaded), 4)
+        for i, shape in enumerate(threaded):
+            self.assertAlmostEqual(shape.centreOfMass()[0],
+                                   shapes[i].centreOfMass()[0], places = 6)
+        
+        eq(len(shapes), 4)
+        eq(len(report), 4)
+        for i, entry in enumerate(report):
+            eq(entry['index'], i)
+            eq(entry['checked'], True)
+            eq(entry['valid'], True)
+            self.assertTrue(entry['checkTime'] >= 0.)
+            self.assertAlmostEqual(shapes[i].volume(), 1., places = 6)
+        
+    def test_readReportTrusted(self):
+        eq = self.assertEqual
+        
+        solids = [Solid().createBox((2.*i,0.,0.),(2.*i + 1.,1.,1.))
+                  for i in range(2)]
+        
+        fd, filename = tempfile.mkstemp(suffix = '.stp')
+        os.close(fd)
+        try:
+            Tools.writeSTEP(filename, solids)
+            setTrusted(True)
+            try:
+                shapes, report = Tools.readSTEP(filename, report = True)
+            finally:
+                setTrusted(False)
+        finally:
+            os.remove(filename)
+        
+        # nothing is checked or fixed in trusted mode
+        eq(len(report), 2)
+        for i, entry in enumerate(report):
+            eq(entry['index'], i)
+            eq(entry['checked'], False)
+            eq(entry['valid'], None)
+            eq(entry['fixed'], None)
+            eq(entry['checkTime'], None)
+            eq(entry['fixTime'], None)
+        
+    def test_stepReader(self):
+        eq = self.assertEqual
+        
+        solids = [Solid().createBox((2.*i,0.,0.),(2.*i + 1.,1.,1.))
+                  for i in range(4)]
+        
+        fd, filename = tempfile.mkstemp(suffix = '.stp')
+        os.close(fd)
+        try:
+            Tools.writeSTEP(filename, solids)
+            streamed = list(StepReader(filename))
+        finally:
+            os.remove(filename)
+        
+        eq(len(streamed), 4)
+        for shape in streamed:
+            self.assertAlmostEqual(shape.volume(), 1., places = 6)
+        
+        reader = StepReader.__new__(StepReader)
+        self.assertRaises(TypeError, repr, reader)
         
 if __name__ == "__main__":
     sys.dont_write_bytecode = True
@@ -5,8 +5,103 @@
 include "OCCIncludes.pxi"
 include "Config.pxi"
 
+# The GIL is released during the modelling operations. Enable the
+# thread safe mode of the OpenCASCADE memory manager.
+Standard_SetReentrant(True)
+
 class OCCError(Exception):
-    pass
+    '''
+    Exception raised by failed operations.
+    
+    The attributes 'operation' and 'type' holds the name of the
+    failed operation and the OpenCASCADE exception type if known.
+    '''
+    def __init__(self, message, operation = '', type = ''):
+        Exception.__init__(self, message)
+        self.operation = operation
+        self.type = type
+
+cdef lastError():
+    '''
+    Return OCCError from the error state of the current thread.
+    '''
+    cdef c_OCCErrorInfo *info = getErrorInfo()
+    return OCCError(info.message, info.operation, info.type)
+
+NORMALS_AUTO = c_NORMALS_AUTO
+NORMALS_SCALAR = c_NORMALS_SCALAR
+NORMALS_SSE = c_NORMALS_SSE
+NORMALS_AVX2 = c_NORMALS_AVX2
+
+EXPORT_BREP = c_EXPORT_BREP
+EXPORT_BINARY = c_EXPORT_BINARY
+EXPORT_STEP = c_EXPORT_STEP
+EXPORT_STL = c_EXPORT_STL
+EXPORT_VRML = c_EXPORT_VRML
+
+def setTrusted(bint trusted):
+    '''
+    Enable or disable trusted mode. In trusted mode the validity
+    check and healing after modelling operations is skipped, for
+    pipelines which validate the result once at the end. The mode
+    applies to the calling thread only.
+    '''
+    baseSetTrusted(trusted)
+
+def isTrusted():
+    '''
+    Return True if trusted mode is enabled.
+    '''
+    return baseIsTrusted()
+
+def setNormalKernel(int kernel):
+    '''
+    Select kernel used to calculate mesh normals.
+    
+    :param kernel: NORMALS_AUTO, NORMALS_SCALAR, NORMALS_SSE or
+                   NORMALS_AVX2
+    
+    Raise OCCError if the kernel is not supported by the cpu.
+    '''
+    if kernel not in (NORMALS_AUTO, NORMALS_SCALAR, NORMALS_SSE, NORMALS_AVX2):
+        raise OCCError('unknown kernel')
+    
+    if not c_setNormalKernel(<c_NormalKernel>kernel):
+        raise OCCError('kernel not supported')
+
+def getNormalKernel():
+    '''
+    Return kernel in use to calculate mesh normals.
+    '''
+    return c_getNormalKernel()
+
+def setMeshCacheBudget(size_t budget):
+    '''
+    Set memory budget in bytes of the mesh cache. Meshes created
+    from the same shape with equal parameters are then returned
+    from the cache. The default budget of 0 disables the cache.
+    '''
+    meshCacheSetBudget(budget)
+
+def clearMeshCache():
+    '''
+    Remove all meshes from the mesh cache and reset counters.
+    '''
+    meshCacheClear()
+
+def getMeshCacheInfo():
+    '''
+    Return dictionary with the memory budget and size in bytes,
+    number of meshes and the hit/miss counters of the mesh cache.
+    '''
+    cdef c_OCCMeshCacheInfo info = meshCacheInfo()
+    return {
+        'budget': info.budget,
+        'size': info.size,
+        'count': info.count,
+        'hits': info.hits,
+        'misses': info.misses,
+    }
 
 cdef class Tesselation:
     '''
@@ -251,4 +346,5 @@ include "OCCVertex.pxi"
 include "OCCEdge.pxi"
 include "OCCWire.pxi"
 include "OCCFace.pxi"
-include "OCCSolid.pxi"
\ No newline at end of file
+include "OCCSolid.pxi"
+include "OCCAssembly.pxi"
\ No newline at end of file
@@ -64,6 +64,8 @@ else:
     OCCLIBS = OCC.split()
     LIBS.append("occmodel")
     LIBS.append("pthread")
+    if sys.platform.startswith('linux'):
+        LIBS.append("rt")
     COMPILE_ARGS.append("-fpermissive")
 
 EXTENSIONS = [